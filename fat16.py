@@ -9,7 +9,7 @@ import math
 # -------------------------------------------------------------------
 SECTOR = 512
 SECTORS_PER_CLUSTER = 1
-RESERVED = 1
+RESERVED = 2          # boot sector + free-space summary (FSInfo layout)
 FATS = 2
 FAT_SIZE = 9
 ROOT_ENTRIES = 224
@@ -18,6 +18,10 @@ TOTAL_SECTORS = 2880
 ROOT_SECTORS = (ROOT_ENTRIES * 32 + SECTOR - 1) // SECTOR
 DATA_START = RESERVED + FATS * FAT_SIZE + ROOT_SECTORS
 
+# clusters the kernel will use: bounded by the data area and the FAT
+CLUSTERS = min((TOTAL_SECTORS - DATA_START) // SECTORS_PER_CLUSTER,
+               FAT_SIZE * SECTOR // 2 - 2)
+
 # -------------------------------------------------------------------
 # Helpers
 # -------------------------------------------------------------------
@@ -96,6 +100,15 @@ def create_image(bootbin, kernelbin, helpfile, snakefile, testfile, outimg):
     snake_cl, _ = alloc(snake)
     test_cl, _ = alloc(test)
 
+    # --- Free-space summary in reserved sector 1 ---
+    info = bytearray(SECTOR)
+    w32(info, 0,   0x41615252)
+    w32(info, 484, 0x61417272)
+    w32(info, 488, CLUSTERS - (nextcl - 2))   # free clusters
+    w32(info, 492, nextcl)                    # next free hint
+    w32(info, 508, 0xAA550000)
+    img[SECTOR:2*SECTOR] = info
+
     # --- Write FATs ---
     for i in range(FATS):
         off = (RESERVED + i * FAT_SIZE) * SECTOR
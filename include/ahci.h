@@ -0,0 +1,28 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+// Sectors moved by one tagged command; larger transfers are split
+// into several commands that are queued at the same time.
+#define AHCI_MAX_SECTORS 128
+
+// Registers "sata0" with the block layer when a disk is found
+int      ahci_init();
+int      ahci_present();
+uint32_t ahci_sector_count();
+
+// Blocking ranged transfers: returns 1 on success, 0 on error
+int ahci_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf);
+int ahci_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf);
+int ahci_flush();
+
+// Queued interface (NCQ when the drive supports it).
+// ahci_submit returns a tag, or -1 when no slot is free.
+// ahci_poll returns 1 done, 0 in flight, -1 error; a finished tag
+// is released by ahci_poll/ahci_wait.
+int ahci_submit(int write, uint32_t lba, uint32_t count, void *buf);
+int ahci_poll(int tag);
+int ahci_wait(int tag);
+
+#endif
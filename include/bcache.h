@@ -0,0 +1,41 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// Sector buffers (512 B each) and hash buckets
+#define BCACHE_BUFFERS   128
+#define BCACHE_BUCKETS   64
+
+// Transfers longer than this bypass the cache (kept coherent with it)
+#define BCACHE_MAX_RUN   16
+
+typedef struct {
+    uint32_t hits;          // sectors served from the cache
+    uint32_t misses;        // sectors read from the device
+    uint32_t writebacks;    // dirty sectors written to the device
+    uint32_t evictions;
+    uint32_t bypassed;      // sectors moved by transfers over BCACHE_MAX_RUN
+    uint32_t cached;        // buffers in use
+    uint32_t dirty;         // buffers waiting for write-back
+} BcacheStats;
+
+// Write-back cache over the block request queue; 1 on success, 0 on error.
+// Dirty sectors reach the device on eviction or bcache_writeback/bcache_sync.
+int  bcache_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+int  bcache_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf);
+
+// Write every dirty sector of `dev` (0 = all devices) and drain the queue
+int  bcache_writeback(BlockDevice *dev);
+
+// bcache_writeback plus a device cache flush
+int  bcache_sync(BlockDevice *dev);
+
+// Bring `buf`, read from the device past the cache (async requests),
+// up to date: pending queue writes and dirty sectors are copied over it
+void bcache_overlay(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+
+void bcache_get_stats(BcacheStats *out);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef BLKQ_H
+#define BLKQ_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// Pending-write slots (one sector each)
+#define BLKQ_DEPTH  64
+
+// Writes larger than this skip the queue (after draining it)
+#define BLKQ_BYPASS (BLKQ_DEPTH / 2)
+
+typedef struct {
+    uint32_t queued;        // sectors accepted into the queue
+    uint32_t absorbed;      // rewrites of a sector that was still pending
+    uint32_t merged;        // sectors folded into a neighbour's command
+    uint32_t commands;      // write commands issued by drains
+    uint32_t drains;
+    uint32_t bypassed;      // sectors written straight through
+    uint32_t readHits;      // sectors read back out of the queue
+    uint32_t depth;         // sectors pending now
+    uint32_t maxDepth;
+} BlkqStats;
+
+// Same contract as blockdev_read / blockdev_write: 1 on success, 0 on error.
+// Writes are buffered and only reach the device on blkq_drain.
+int  blkq_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+int  blkq_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf);
+
+// Issue the pending writes of `dev` (0 = every device) in LBA order,
+// one command per run of adjacent sectors
+int  blkq_drain(BlockDevice *dev);
+
+// Copy pending writes of [lba, lba + count) over `buf`, which was read
+// from the device past the queue
+void blkq_overlay(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+
+void blkq_get_stats(BlkqStats *out);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+
+#define BLOCKDEV_MAX          8
+#define BLOCKDEV_SECTOR_SIZE  512
+
+typedef struct BlockDevice  BlockDevice;
+typedef struct BlockRequest BlockRequest;
+
+// Request status
+#define BLKREQ_PENDING  0
+#define BLKREQ_DONE     1
+#define BLKREQ_ERROR    (-1)
+
+// Completion callback; runs from blockdev_submit (synchronous devices),
+// blockdev_poll or blockdev_wait, never from an interrupt
+typedef void (*blockdev_done_t)(BlockRequest *req);
+
+struct BlockRequest {
+    BlockDevice    *dev;
+    int             write;
+    uint32_t        lba;
+    uint32_t        count;
+    void           *buf;
+    blockdev_done_t done;       // optional
+    void           *ctx;        // for the callback
+    int             status;     // BLKREQ_*
+    int             tag;        // driver handle while pending
+};
+
+// Driver entry points; all return 1 on success, 0 on error.
+// submit/poll/wait are optional: without them requests complete
+// synchronously inside blockdev_submit.
+typedef struct {
+    int (*read)(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+    int (*write)(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf);
+    int (*flush)(BlockDevice *dev);
+
+    int (*submit)(BlockDevice *dev, BlockRequest *req);    // 0 = cannot queue it
+    int (*poll)(BlockDevice *dev, BlockRequest *req);      // 1 done, 0 pending, -1 error
+    int (*wait)(BlockDevice *dev, BlockRequest *req);      // 1 done, 0 error
+} BlockDeviceOps;
+
+struct BlockDevice {
+    const char           *name;
+    const BlockDeviceOps *ops;
+    uint32_t              sectorCount;    // geometry: total sectors
+    uint16_t              sectorSize;     // geometry: bytes per sector
+    void                 *priv;
+};
+
+// Registration order is mount preference: blockdev_get(0) is the boot disk
+int          blockdev_register(BlockDevice *dev);
+int          blockdev_count();
+BlockDevice *blockdev_get(int index);
+BlockDevice *blockdev_find(const char *name);
+
+int blockdev_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf);
+int blockdev_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf);
+int blockdev_flush(BlockDevice *dev);
+
+// Asynchronous interface. Fill dev/write/lba/count/buf (and done/ctx)
+// then submit; the buffer must stay valid until the request completes.
+// blockdev_submit returns 0 only for an invalid request.
+int blockdev_submit(BlockRequest *req);
+int blockdev_submit_batch(BlockRequest *reqs, int n);
+int blockdev_poll(BlockRequest *req);       // 1 done, 0 pending, -1 error
+int blockdev_wait(BlockRequest *req);       // 1 done, 0 error
+
+#endif
@@ -2,6 +2,7 @@
 #define FAT16_H
 
 #include <stdint.h>
+#include "blockdev.h"
 
 #define FAT16_SECTOR_SIZE    512
 #define FAT16_MAX_FILENAME   12     // "XXXXXXXX.XXX\0"
@@ -64,11 +65,89 @@ typedef struct {
     uint32_t size;
 } __attribute__((packed)) Fat16DirEntry;
 
+// Volumes mounted at the same time (whole disks or MBR partitions)
+#define FAT16_MAX_VOLUMES    4
+
+// Directory levels below the root kept by name for the cwd path, and
+// the matching buffer size for fat16_get_path. Deeper directories work;
+// their part of the path is shown as "/...".
+#define FAT16_MAX_DEPTH      16
+#define FAT16_PATH_MAX       (FAT16_MAX_DEPTH * 13 + 6)
+
+// Files open at the same time (fat16_open)
+#define FAT16_MAX_FILES      16
+
+// fat16_open modes
+#define FAT16_O_READ         0x01
+#define FAT16_O_WRITE        0x02
+#define FAT16_O_CREATE       0x04   // create the file if missing
+#define FAT16_O_TRUNC        0x08   // cut to 0 bytes (with FAT16_O_WRITE)
+#define FAT16_O_APPEND       0x10   // every write goes to the end
+
+// fat16_lseek origins
+#define FAT16_SEEK_SET       0
+#define FAT16_SEEK_CUR       1
+#define FAT16_SEEK_END       2
+
+typedef struct {
+    const char *deviceName;
+    uint32_t    startLBA;
+    uint32_t    sectors;
+    uint32_t    clusterCount;
+    uint32_t    clusterSize;
+    uint32_t    freeClusters;
+    uint32_t    fatWrites;          // FAT sectors written (first copy)
+    uint32_t    mirrorWrites;       // FAT sectors written (other copies)
+} Fat16VolumeInfo;
+
+// Directory iterator (fat16_opendir); holds one directory sector, so a
+// directory of any size is walked without a full copy of it
+typedef struct {
+    const void   *vol;
+    uint16_t      cluster;      // cluster being walked, 0 = root directory
+    uint32_t      sector;       // next sector within the root area / cluster
+    uint32_t      lba;          // LBA of block
+    int           slot;         // next entry of block
+    int           done;
+    Fat16DirEntry block[16];
+} Fat16Dir;
+
 // ============================================================
 // Public API
 // ============================================================
 
-int fat16_init();
+// Mount all FAT16 volumes on dev and make the first one current
+int fat16_init(BlockDevice *dev);
+int fat16_mount(BlockDevice *dev);
+
+// volume selection: every other call works on the current volume
+int fat16_volume_count();
+int fat16_get_volume();
+int fat16_set_volume(int index);
+int fat16_volume_info(int index, Fat16VolumeInfo *out);
+
+// Write all cached changes of every mounted volume to disk
+int fat16_sync();
+
+// Give data held back by delayed allocation its clusters and write it
+// out (into the buffer cache). Called after every shell command, so a
+// buffer never outlives the command that filled it. 0 if the volume
+// is full; the data then stays buffered.
+int fat16_flush_delayed();
+
+// Boot prefetch log: call once per shell command; saves the log of
+// clusters read so far once the recording window has passed
+void fat16_bootlog_tick();
+
+// Dentry cache counters
+void fat16_dcache_stats(uint32_t *hits, uint32_t *misses);
+
+// Directory iteration: entries in on-disk order, skipping free, deleted
+// and LFN slots. fat16_readdir returns 0 at the end; outLBA/outIndex
+// (may be 0) give the slot for fat16_get_entry/fat16_set_entry.
+void fat16_opendir(Fat16Dir *d, uint16_t dirCluster);
+int  fat16_readdir(Fat16Dir *d, Fat16DirEntry *out, uint32_t *outLBA, int *outIndex);
+void fat16_closedir(Fat16Dir *d);
 
 // directory handling
 void fat16_list_directory(uint16_t dirCluster);
@@ -111,4 +190,23 @@ int fat16_rename(const char *oldName, const char *newName);
 
 uint32_t fat16_read_partial(const char *filename, void *buffer, uint32_t size, uint32_t offset);
 
+// Write `size` bytes at `offset` (at most the file size) / at the end.
+// Only the clusters touched are rewritten. Returns the bytes written.
+uint32_t fat16_write_at(const char *filename, const void *data, uint32_t size, uint32_t offset);
+uint32_t fat16_append(const char *filename, const void *data, uint32_t size);
+
+// Reserve clusters for the first `bytes` of the file, contiguous where
+// the free space allows; the size is unchanged. 1 on success.
+int fat16_preallocate(const char *filename, uint32_t bytes);
+
+// File handles: a handle keeps its directory slot and a cursor into the
+// cluster chain, so sequential reads and writes do not rescan the
+// directory or rewalk the chain. open/read/write/lseek return -1 on error;
+// read and write return the bytes moved. Deleting an open file fails.
+int fat16_open(const char *filename, int mode);
+int fat16_read(int fd, void *buffer, uint32_t size);
+int fat16_write(int fd, const void *buffer, uint32_t size);
+int fat16_lseek(int fd, int offset, int whence);
+int fat16_close(int fd);
+
 #endif
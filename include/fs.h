@@ -12,6 +12,7 @@ int  fs_delete(const char *name);
 int  fs_create(const char *name);
 int  fs_read(const char *name, void *buf, int maxSize);
 int  fs_write(const char *name, const void *buf, int size);
+int  fs_append(const char *name, const void *buf, int size);
 int  fs_mkdir(const char *name);
 int fs_cd(const char *dirname);
 int fs_rename(const char *oldDirName, const char *newDirName);
@@ -3,6 +3,19 @@
 
 #include <stdint.h>
 
+// Registers "ide0" with the block layer when a drive is found
+void ide_init();
+uint32_t ide_sector_count();
+
+// Status / error register of the last failed command
+void ide_last_error(uint8_t *status, uint8_t *error);
+
+// Ranged transfers: returns 1 on success, 0 on drive error
+int  ide_read_sectors(uint32_t lba, uint32_t count, uint8_t* buf);
+int  ide_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buf);
+
+int  ide_flush();
+
 void ide_read_sector(uint32_t lba, uint8_t* buf);
 void ide_write_sector(uint32_t lba, const uint8_t* buf);
 
@@ -0,0 +1,27 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+// PIT tick rate used for timeouts
+#define IRQ_TIMER_HZ  100
+
+// Legacy PIC lines
+#define IRQ_TIMER     0
+#define IRQ_CASCADE   2
+#define IRQ_ATA_PRIMARY 14
+
+// Handlers that can share one line
+#define IRQ_MAX_SHARED 4
+
+typedef void (*irq_handler_t)(void);
+
+void     irq_init(void);
+
+// Add a handler to the line's chain; 0 if the chain is full (the
+// driver then polls)
+int      irq_install_handler(int irq, irq_handler_t handler);
+
+uint32_t irq_ticks(void);
+
+#endif /* IRQ_H */
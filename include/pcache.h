@@ -0,0 +1,38 @@
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include <stdint.h>
+
+// File data page cache: 512-byte pages keyed by (owner, cluster, sector
+// within the cluster). The owner is whatever identifies the volume.
+//
+// Page table and pages live in a fixed region above the RAM disk area
+// (0x400000 - 0xBFFFFF) and below the ELF load address (0x1000000).
+#define PCACHE_META_BASE     0x00C00000
+#define PCACHE_DATA_BASE     0x00C40000
+#define PCACHE_PAGE_SIZE     512
+#define PCACHE_MAX_PAGES     ((0x01000000 - PCACHE_DATA_BASE) / PCACHE_PAGE_SIZE)
+
+// Default memory budget, changeable at run time with pcache_set_budget
+#define PCACHE_DEFAULT_PAGES 2048       // 1 MB
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t pages;         // pages in use
+    uint32_t budget;        // pages allowed
+} PcacheStats;
+
+// Copy a cached page to `out`; 1 on hit, 0 on miss
+int  pcache_lookup(const void *owner, uint16_t cluster, uint8_t index, void *out);
+int  pcache_contains(const void *owner, uint16_t cluster, uint8_t index);
+void pcache_insert(const void *owner, uint16_t cluster, uint8_t index, const void *data);
+
+// Drop cached pages [first, first + count) of `cluster` (freed or rewritten)
+void pcache_invalidate(const void *owner, uint16_t cluster, uint8_t first, uint8_t count);
+
+void pcache_set_budget(uint32_t pages);
+void pcache_get_stats(PcacheStats *out);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// PCI command register bits
+#define PCI_CMD_IO          0x0001
+#define PCI_CMD_MEMORY      0x0002
+#define PCI_CMD_BUS_MASTER  0x0004
+
+typedef struct {
+    uint8_t  bus;
+    uint8_t  slot;
+    uint8_t  func;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  classCode;
+    uint8_t  subclass;
+    uint8_t  progIf;
+} PciDevice;
+
+uint32_t pci_read32(const PciDevice *dev, uint8_t offset);
+uint16_t pci_read16(const PciDevice *dev, uint8_t offset);
+void     pci_write32(const PciDevice *dev, uint8_t offset, uint32_t value);
+void     pci_write16(const PciDevice *dev, uint8_t offset, uint16_t value);
+
+// Scan bus 0..255 for the first match; returns 1 if found
+int pci_find_class(uint8_t classCode, uint8_t subclass, PciDevice *out);
+int pci_find_device(uint16_t vendor, uint16_t device, PciDevice *out);
+
+uint32_t pci_bar(const PciDevice *dev, int index);
+int      pci_bar_is_io(const PciDevice *dev, int index);
+void     pci_enable(const PciDevice *dev, uint16_t cmdBits);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// RAM disk image lives above the user program area (0x100000), the
+// syscall table (0x200000) and the FAT16 write buffers (0x300000)
+#define RAMDISK_BASE         0x00400000
+#define RAMDISK_MAX_SECTORS  (8 * 1024 * 1024 / BLOCKDEV_SECTOR_SIZE)
+
+// Register an image that is already in memory (e.g. put there by the loader)
+BlockDevice *ramdisk_init(void *base, uint32_t sectors);
+
+// Copy the first `sectors` sectors of `src` to RAMDISK_BASE and register it
+BlockDevice *ramdisk_load(BlockDevice *src, uint32_t sectors);
+
+#endif
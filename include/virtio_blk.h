@@ -0,0 +1,18 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+// Registers "vda" with the block layer when the device is found
+int      virtio_blk_init();
+int      virtio_blk_present();
+uint32_t virtio_blk_sector_count();
+
+// Blocking ranged transfers: returns 1 on success, 0 on error.
+// Large transfers are split into several requests that are posted
+// to the virtqueue together and announced with a single notify.
+int virtio_blk_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf);
+int virtio_blk_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf);
+int virtio_blk_flush();
+
+#endif
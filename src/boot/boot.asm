@@ -3,8 +3,8 @@
 
 %define BPS            512
 %define ROOT_SECTS     14
-%define ROOT_START     19
-%define DATA_START     33
+%define ROOT_START     20
+%define DATA_START     34
 
 %define KERNEL_LOAD_SEG 0x1000
 %define KERNEL_ENTRY    0x10000
@@ -19,7 +19,7 @@ nop
 OEMLabel        db "MSWIN4.1"
 BPB_BytsPerSec  dw 512
 BPB_SecPerClus  db 1
-BPB_RsvdSecCnt  dw 1
+BPB_RsvdSecCnt  dw 2
 BPB_NumFATs     db 2
 BPB_RootEntCnt  dw 224
 BPB_TotSec16    dw 2880
@@ -127,6 +127,11 @@ load_kernel:
     call read_sector
 
     add bx, BPS
+    jnz .same_segment
+    mov dx, es              ; past 64 KB: next segment
+    add dx, 0x1000
+    mov es, dx
+.same_segment:
     pop cx
     pop ax
 
@@ -0,0 +1,518 @@
+#include "ahci.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "irq.h"
+#include "terminal.h"
+#include "string.h"
+
+/*
+ * AHCI (QEMU ich9-ahci) driver for the first SATA disk.
+ * All structures live in identity-mapped kernel memory, so their
+ * addresses can be handed to the HBA as-is.
+ */
+#define AHCI_MAX_CMDS    32
+#define AHCI_PRDT_MAX    8
+
+#define SATA_SIG_ATA     0x00000101
+
+// HBA global registers
+#define HBA_CAP_SNCQ     (1u << 30)
+#define HBA_GHC_AE       (1u << 31)
+#define HBA_GHC_IE       (1u << 1)
+
+// Port registers
+#define PORT_CMD_ST      (1u << 0)
+#define PORT_CMD_FRE     (1u << 4)
+#define PORT_CMD_FR      (1u << 14)
+#define PORT_CMD_CR      (1u << 15)
+
+#define PORT_IS_DHRS     (1u << 0)
+#define PORT_IS_SDBS     (1u << 3)
+#define PORT_IS_TFES     (1u << 30)
+
+#define PORT_TFD_BSY     0x80
+#define PORT_TFD_DRQ     0x08
+
+#define FIS_TYPE_REG_H2D 0x27
+
+#define ATA_CMD_READ_DMA_EXT      0x25
+#define ATA_CMD_WRITE_DMA_EXT     0x35
+#define ATA_CMD_READ_FPDMA        0x60
+#define ATA_CMD_WRITE_FPDMA       0x61
+#define ATA_CMD_FLUSH_CACHE_EXT   0xEA
+#define ATA_CMD_IDENTIFY          0xEC
+
+#define AHCI_TIMEOUT_TICKS (3 * IRQ_TIMER_HZ)
+
+typedef volatile struct {
+    uint32_t clb, clbu, fb, fbu;
+    uint32_t is, ie, cmd, rsv0;
+    uint32_t tfd, sig, ssts, sctl;
+    uint32_t serr, sact, ci, sntf;
+    uint32_t fbs;
+    uint32_t rsv1[11];
+    uint32_t vendor[4];
+} HbaPort;
+
+typedef volatile struct {
+    uint32_t cap, ghc, is, pi;
+    uint32_t vs, cccCtl, cccPts, emLoc;
+    uint32_t emCtl, cap2, bohc;
+    uint8_t  rsv[0xA0 - 0x2C];
+    uint8_t  vendor[0x100 - 0xA0];
+    HbaPort  ports[32];
+} HbaMem;
+
+typedef struct {
+    uint16_t flags;             // CFL[4:0], W = bit 6
+    uint16_t prdtl;
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t rsv[4];
+} AhciCmdHeader;
+
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t rsv;
+    uint32_t dbc;               // byte count - 1, bit 31 = IRQ on completion
+} AhciPrd;
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t rsv[48];
+    AhciPrd prdt[AHCI_PRDT_MAX];
+} AhciCmdTable;
+
+enum { SLOT_FREE, SLOT_BUSY, SLOT_DONE, SLOT_ERROR };
+
+static AhciCmdHeader cmdList[AHCI_MAX_CMDS] __attribute__((aligned(1024)));
+static uint8_t       fisArea[256]           __attribute__((aligned(256)));
+static AhciCmdTable  cmdTables[AHCI_MAX_CMDS] __attribute__((aligned(128)));
+
+static HbaMem  *hba = 0;
+static HbaPort *port = 0;
+
+static int      ahci_ncq = 0;         // drive + HBA support NCQ
+static int      ahci_depth = 1;       // commands we keep in flight
+static uint32_t ahci_sectors = 0;
+
+static uint8_t  slotState[AHCI_MAX_CMDS];
+static uint32_t slotBusy = 0;         // tags issued to the HBA
+
+static int ahci_irq_line = -1;
+
+// Task-file error seen by the interrupt handler, which acknowledges it
+// along with everything else; ahci_reap picks it up from here
+static volatile int tfError = 0;
+
+// ------------------------------------------------------------
+// Interrupt: just acknowledge; waiters re-check CI/SACT.
+// ------------------------------------------------------------
+static void ahci_irq() {
+    uint32_t pis = port->is;
+    if (pis & PORT_IS_TFES)
+        tfError = 1;
+    port->is = pis;
+    hba->is = hba->is;
+}
+
+static int ahci_stop_port() {
+    uint32_t start = irq_ticks();
+
+    port->cmd &= ~PORT_CMD_ST;
+    while (port->cmd & PORT_CMD_CR)
+        if (irq_ticks() - start > AHCI_TIMEOUT_TICKS) return 0;
+
+    port->cmd &= ~PORT_CMD_FRE;
+    while (port->cmd & PORT_CMD_FR)
+        if (irq_ticks() - start > AHCI_TIMEOUT_TICKS) return 0;
+
+    return 1;
+}
+
+static void ahci_start_port() {
+    while (port->cmd & PORT_CMD_CR) {}
+
+    port->cmd |= PORT_CMD_FRE;
+    port->cmd |= PORT_CMD_ST;
+}
+
+// Fail everything in flight and restart the port after a task-file error
+static void ahci_recover() {
+    for (int t = 0; t < AHCI_MAX_CMDS; t++)
+        if (slotBusy & (1u << t))
+            slotState[t] = SLOT_ERROR;
+    slotBusy = 0;
+    tfError = 0;
+
+    terminal_printf("[AHCI] task file error (tfd %x, serr %x)\n", port->tfd, port->serr);
+
+    ahci_stop_port();
+    port->serr = 0xFFFFFFFF;
+    port->is = 0xFFFFFFFF;
+    ahci_start_port();
+}
+
+// Move finished commands from BUSY to DONE
+static void ahci_reap() {
+    if (tfError || (port->is & PORT_IS_TFES)) {
+        ahci_recover();
+        return;
+    }
+
+    uint32_t active = port->ci | (ahci_ncq ? port->sact : 0);
+    uint32_t done = slotBusy & ~active;
+
+    for (int t = 0; done; t++) {
+        if (done & (1u << t)) {
+            slotState[t] = SLOT_DONE;
+            done &= ~(1u << t);
+        }
+    }
+    slotBusy &= active;
+}
+
+static void ahci_build_fis(uint8_t *fis, uint8_t cmd, uint32_t lba, uint16_t count, int tag, int ncq) {
+    k_memset(fis, 0, 20);
+
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;                  // command, not control
+    fis[2] = cmd;
+
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[7] = 0x40;                  // LBA mode
+    fis[8] = (uint8_t)(lba >> 24);
+
+    if (ncq) {
+        // FPDMA: count lives in FEATURES, tag in COUNT[7:3]
+        fis[3]  = (uint8_t)count;
+        fis[11] = (uint8_t)(count >> 8);
+        fis[12] = (uint8_t)(tag << 3);
+    } else {
+        fis[12] = (uint8_t)count;
+        fis[13] = (uint8_t)(count >> 8);
+    }
+}
+
+static int ahci_issue(int tag, uint8_t cmd, int write, uint32_t lba, uint32_t count,
+                      void *buf, uint32_t bytes, int ncq) {
+    AhciCmdHeader *hdr = &cmdList[tag];
+    AhciCmdTable  *tbl = &cmdTables[tag];
+
+    hdr->flags = 5 | (write ? (1 << 6) : 0);    // 5 dwords of CFIS
+    hdr->prdtl = bytes ? 1 : 0;
+    hdr->prdbc = 0;
+    hdr->ctba  = (uint32_t)tbl;
+    hdr->ctbau = 0;
+
+    tbl->prdt[0].dba  = (uint32_t)buf;
+    tbl->prdt[0].dbau = 0;
+    tbl->prdt[0].rsv  = 0;
+    tbl->prdt[0].dbc  = (bytes - 1) | (1u << 31);
+
+    ahci_build_fis(tbl->cfis, cmd, lba, (uint16_t)count, tag, ncq);
+
+    slotState[tag] = SLOT_BUSY;
+    slotBusy |= 1u << tag;
+
+    if (ncq)
+        port->sact = 1u << tag;
+    port->ci = 1u << tag;
+    return tag;
+}
+
+static int ahci_alloc_slot() {
+    for (int t = 0; t < ahci_depth; t++)
+        if (slotState[t] == SLOT_FREE)
+            return t;
+    return -1;
+}
+
+int ahci_submit(int write, uint32_t lba, uint32_t count, void *buf) {
+    if (!port || count == 0 || count > AHCI_MAX_SECTORS) return -1;
+    if ((uint32_t)buf & 1) return -1;      // PRD data must be word aligned
+
+    int tag = ahci_alloc_slot();
+    if (tag < 0) return -1;
+
+    uint8_t cmd;
+    if (ahci_ncq)
+        cmd = write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+    else
+        cmd = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+
+    return ahci_issue(tag, cmd, write, lba, count, buf, count * 512, ahci_ncq);
+}
+
+int ahci_poll(int tag) {
+    if (slotState[tag] == SLOT_BUSY)
+        ahci_reap();
+
+    switch (slotState[tag]) {
+        case SLOT_BUSY:
+            return 0;
+        case SLOT_DONE:
+            slotState[tag] = SLOT_FREE;
+            return 1;
+        default:
+            slotState[tag] = SLOT_FREE;
+            return -1;
+    }
+}
+
+int ahci_wait(int tag) {
+    uint32_t start = irq_ticks();
+
+    for (;;) {
+        __asm__ volatile("cli");
+
+        int r = ahci_poll(tag);
+        if (r) {
+            __asm__ volatile("sti");
+            return r > 0;
+        }
+
+        if (irq_ticks() - start > AHCI_TIMEOUT_TICKS) {
+            __asm__ volatile("sti");
+            terminal_write_line("[AHCI] command timeout");
+            ahci_recover();
+            slotState[tag] = SLOT_FREE;
+            return 0;
+        }
+
+        // woken by the AHCI interrupt or, at worst, the next timer tick
+        if (ahci_irq_line >= 0)
+            __asm__ volatile("sti; hlt");
+        else
+            __asm__ volatile("sti");
+    }
+}
+
+// ------------------------------------------------------------
+// Ranged transfers: keep up to ahci_depth tagged commands queued
+// ------------------------------------------------------------
+static int ahci_transfer(int write, uint32_t lba, uint32_t count, uint8_t *buf) {
+    int tags[AHCI_MAX_CMDS];
+    int head = 0, issued = 0;
+    int ok = 1;
+
+    if (!port) return 0;
+
+    // odd buffers cannot be described by a PRD: bounce one sector at a time
+    if ((uint32_t)buf & 1) {
+        static uint8_t bounce[512] __attribute__((aligned(4)));
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (write) k_memcpy(bounce, buf + i * 512, 512);
+
+            int tag = ahci_submit(write, lba + i, 1, bounce);
+            if (tag < 0 || !ahci_wait(tag)) return 0;
+
+            if (!write) k_memcpy(buf + i * 512, bounce, 512);
+        }
+        return 1;
+    }
+
+    while (count || issued) {
+        // after a failed command only the ones in flight are retired
+        while (count && ok && issued < ahci_depth) {
+            uint32_t n = count > AHCI_MAX_SECTORS ? AHCI_MAX_SECTORS : count;
+
+            int tag = ahci_submit(write, lba, n, buf);
+            if (tag < 0) break;
+
+            tags[(head + issued) % AHCI_MAX_CMDS] = tag;
+            issued++;
+
+            lba += n;
+            buf += n * 512;
+            count -= n;
+        }
+
+        if (!issued) return 0;
+
+        // retire the oldest; the rest keep the drive busy meanwhile
+        if (!ahci_wait(tags[head])) ok = 0;
+        head = (head + 1) % AHCI_MAX_CMDS;
+        issued--;
+    }
+    return ok;
+}
+
+int ahci_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf) {
+    return ahci_transfer(0, lba, count, buf);
+}
+
+int ahci_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf) {
+    return ahci_transfer(1, lba, count, (uint8_t *)buf);
+}
+
+// Non-queued, so only valid with nothing in flight (true between transfers)
+int ahci_flush() {
+    int tag = 0;
+
+    if (!port || slotState[tag] != SLOT_FREE) return 0;
+
+    ahci_issue(tag, ATA_CMD_FLUSH_CACHE_EXT, 0, 0, 0, 0, 0, 0);
+    return ahci_wait(tag);
+}
+
+// ------------------------------------------------------------
+// Block device glue
+// ------------------------------------------------------------
+static int ahci_bdev_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    (void)dev;
+    return ahci_read_sectors(lba, count, buf);
+}
+
+static int ahci_bdev_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    (void)dev;
+    return ahci_write_sectors(lba, count, buf);
+}
+
+static int ahci_bdev_flush(BlockDevice *dev) {
+    (void)dev;
+    return ahci_flush();
+}
+
+// One tagged command per request; anything larger or unaligned is
+// left to the synchronous path
+static int ahci_bdev_submit(BlockDevice *dev, BlockRequest *req) {
+    (void)dev;
+    int tag = ahci_submit(req->write, req->lba, req->count, req->buf);
+    if (tag < 0) return 0;
+
+    req->tag = tag;
+    return 1;
+}
+
+static int ahci_bdev_poll(BlockDevice *dev, BlockRequest *req) {
+    (void)dev;
+    return ahci_poll(req->tag);
+}
+
+static int ahci_bdev_wait(BlockDevice *dev, BlockRequest *req) {
+    (void)dev;
+    return ahci_wait(req->tag);
+}
+
+static const BlockDeviceOps ahciOps = {
+    .read   = ahci_bdev_read,
+    .write  = ahci_bdev_write,
+    .flush  = ahci_bdev_flush,
+    .submit = ahci_bdev_submit,
+    .poll   = ahci_bdev_poll,
+    .wait   = ahci_bdev_wait,
+};
+
+static BlockDevice ahciDev = {
+    .name       = "sata0",
+    .ops        = &ahciOps,
+    .sectorSize = BLOCKDEV_SECTOR_SIZE,
+};
+
+// ------------------------------------------------------------
+// Init: PCI discovery, port setup, IDENTIFY
+// ------------------------------------------------------------
+static int ahci_identify(uint16_t *id) {
+    int tag = 0;
+
+    ahci_issue(tag, ATA_CMD_IDENTIFY, 0, 0, 0, id, 512, 0);
+    return ahci_wait(tag);
+}
+
+int ahci_init() {
+    PciDevice dev;
+
+    if (!pci_find_class(0x01, 0x06, &dev))
+        return 0;
+
+    pci_enable(&dev, PCI_CMD_MEMORY | PCI_CMD_BUS_MASTER);
+    hba = (HbaMem *)pci_bar(&dev, 5);
+    hba->ghc |= HBA_GHC_AE;
+
+    // first implemented port with a SATA disk attached
+    for (int i = 0; i < 32; i++) {
+        if (!(hba->pi & (1u << i))) continue;
+
+        HbaPort *p = &hba->ports[i];
+        if ((p->ssts & 0x0F) != 3) continue;        // DET: device present
+        if (p->sig != SATA_SIG_ATA) continue;
+
+        port = p;
+        break;
+    }
+
+    if (!port) return 0;
+
+    if (!ahci_stop_port()) {
+        port = 0;
+        return 0;
+    }
+
+    k_memset(cmdList, 0, sizeof(cmdList));
+    k_memset(fisArea, 0, sizeof(fisArea));
+    k_memset(cmdTables, 0, sizeof(cmdTables));
+    k_memset(slotState, 0, sizeof(slotState));
+    slotBusy = 0;
+
+    port->clb  = (uint32_t)cmdList;
+    port->clbu = 0;
+    port->fb   = (uint32_t)fisArea;
+    port->fbu  = 0;
+    port->serr = 0xFFFFFFFF;
+    port->is   = 0xFFFFFFFF;
+
+    // interrupts only wake us up; completion is read from CI/SACT
+    uint8_t line = pci_read16(&dev, 0x3C) & 0xFF;
+    if (line < 16 && irq_install_handler(line, ahci_irq)) {
+        ahci_irq_line = line;
+        port->ie = PORT_IS_DHRS | PORT_IS_SDBS | PORT_IS_TFES;
+        hba->ghc |= HBA_GHC_IE;
+    }
+
+    ahci_start_port();
+
+    static uint16_t id[256] __attribute__((aligned(4)));
+    ahci_depth = 1;
+    ahci_ncq = 0;
+
+    if (!ahci_identify(id)) {
+        port = 0;
+        return 0;
+    }
+
+    if (id[83] & (1 << 10))         // LBA48
+        ahci_sectors = id[100] | ((uint32_t)id[101] << 16);
+    else
+        ahci_sectors = id[60] | ((uint32_t)id[61] << 16);
+
+    // word 76 bit 8: NCQ, word 75: queue depth - 1
+    if ((hba->cap & HBA_CAP_SNCQ) && (id[76] & (1 << 8))) {
+        uint32_t slots = ((hba->cap >> 8) & 0x1F) + 1;
+        uint32_t qd = (id[75] & 0x1F) + 1;
+
+        ahci_ncq = 1;
+        ahci_depth = qd < slots ? qd : slots;
+    }
+
+    terminal_printf("AHCI: SATA disk, %u sectors, NCQ depth %d\n",
+                    ahci_sectors, ahci_ncq ? ahci_depth : 0);
+
+    ahciDev.sectorCount = ahci_sectors;
+    blockdev_register(&ahciDev);
+    return 1;
+}
+
+int ahci_present() {
+    return port != 0;
+}
+
+uint32_t ahci_sector_count() {
+    return ahci_sectors;
+}
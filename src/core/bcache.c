@@ -0,0 +1,265 @@
+#include "bcache.h"
+#include "blkq.h"
+#include "string.h"
+
+#define BCACHE_NONE  (-1)
+
+typedef struct {
+    BlockDevice *dev;           // 0 = buffer unused
+    uint32_t     lba;
+    uint8_t      dirty;
+    int16_t      hashNext;
+    int16_t      lruPrev;       // towards the most recently used end
+    int16_t      lruNext;
+} BcacheBuf;
+
+static BcacheBuf bufs[BCACHE_BUFFERS];
+static uint8_t   bufData[BCACHE_BUFFERS][BLOCKDEV_SECTOR_SIZE];
+
+static int16_t buckets[BCACHE_BUCKETS];
+static int16_t lruHead = BCACHE_NONE;     // most recently used
+static int16_t lruTail = BCACHE_NONE;     // next victim
+static int     ready = 0;
+
+static BcacheStats stats;
+
+// ------------------------------------------------------------
+// Setup: every buffer starts unused on the LRU list
+// ------------------------------------------------------------
+static void bcache_setup() {
+    for (int i = 0; i < BCACHE_BUCKETS; i++)
+        buckets[i] = BCACHE_NONE;
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        bufs[i].dev = 0;
+        bufs[i].hashNext = BCACHE_NONE;
+        bufs[i].lruPrev = i - 1;
+        bufs[i].lruNext = (i + 1 < BCACHE_BUFFERS) ? i + 1 : BCACHE_NONE;
+    }
+    lruHead = 0;
+    lruTail = BCACHE_BUFFERS - 1;
+    ready = 1;
+}
+
+static inline int bucket_of(BlockDevice *dev, uint32_t lba) {
+    return (lba ^ ((uint32_t)dev >> 4)) % BCACHE_BUCKETS;
+}
+
+static int lookup(BlockDevice *dev, uint32_t lba) {
+    for (int i = buckets[bucket_of(dev, lba)]; i != BCACHE_NONE; i = bufs[i].hashNext)
+        if (bufs[i].dev == dev && bufs[i].lba == lba)
+            return i;
+    return BCACHE_NONE;
+}
+
+static void unhash(int idx) {
+    int16_t *link = &buckets[bucket_of(bufs[idx].dev, bufs[idx].lba)];
+
+    while (*link != idx)
+        link = &bufs[*link].hashNext;
+    *link = bufs[idx].hashNext;
+    bufs[idx].dev = 0;
+}
+
+static void lru_unlink(int idx) {
+    BcacheBuf *b = &bufs[idx];
+
+    if (b->lruPrev != BCACHE_NONE) bufs[b->lruPrev].lruNext = b->lruNext;
+    else lruHead = b->lruNext;
+
+    if (b->lruNext != BCACHE_NONE) bufs[b->lruNext].lruPrev = b->lruPrev;
+    else lruTail = b->lruPrev;
+}
+
+static void lru_touch(int idx) {
+    if (lruHead == idx) return;
+
+    lru_unlink(idx);
+    bufs[idx].lruPrev = BCACHE_NONE;
+    bufs[idx].lruNext = lruHead;
+    bufs[lruHead].lruPrev = idx;
+    lruHead = idx;
+}
+
+// Dropped buffers go to the victim end so they are reused first
+static void lru_demote(int idx) {
+    if (lruTail == idx) return;
+
+    lru_unlink(idx);
+    bufs[idx].lruNext = BCACHE_NONE;
+    bufs[idx].lruPrev = lruTail;
+    bufs[lruTail].lruNext = idx;
+    lruTail = idx;
+}
+
+static int write_back(int idx) {
+    BcacheBuf *b = &bufs[idx];
+
+    b->dirty = 0;
+    stats.writebacks++;
+    return blkq_write(b->dev, b->lba, 1, bufData[idx]);
+}
+
+// Take the least recently used buffer for (dev, lba)
+static int grab(BlockDevice *dev, uint32_t lba) {
+    int idx = lruTail;
+    BcacheBuf *b = &bufs[idx];
+
+    if (b->dev) {
+        if (b->dirty) write_back(idx);
+        unhash(idx);
+        stats.evictions++;
+    }
+
+    int bk = bucket_of(dev, lba);
+    b->dev = dev;
+    b->lba = lba;
+    b->dirty = 0;
+    b->hashNext = buckets[bk];
+    buckets[bk] = idx;
+
+    lru_touch(idx);
+    return idx;
+}
+
+// ------------------------------------------------------------
+// Read
+// ------------------------------------------------------------
+int bcache_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    uint8_t *dst = (uint8_t *)buf;
+    uint32_t cached = 0;
+
+    if (!dev || !count) return 0;
+    if (!ready) bcache_setup();
+
+    // pass 1: note cached sectors and pin them at the MRU end
+    for (uint32_t i = 0; i < count; i++) {
+        int idx = lookup(dev, lba + i);
+        if (idx == BCACHE_NONE) continue;
+
+        lru_touch(idx);
+        cached++;
+    }
+
+    if (cached == count) {
+        for (uint32_t i = 0; i < count; i++)
+            k_memcpy(dst + i * BLOCKDEV_SECTOR_SIZE,
+                     bufData[lookup(dev, lba + i)], BLOCKDEV_SECTOR_SIZE);
+        stats.hits += count;
+        return 1;
+    }
+
+    if (!blkq_read(dev, lba, count, buf))
+        return 0;
+
+    // pass 2: dirty cached copies are newer than the device; fill the rest
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *sec = dst + i * BLOCKDEV_SECTOR_SIZE;
+        int idx = lookup(dev, lba + i);
+
+        if (idx != BCACHE_NONE) {
+            if (bufs[idx].dirty)
+                k_memcpy(sec, bufData[idx], BLOCKDEV_SECTOR_SIZE);
+            stats.hits++;
+        } else if (count <= BCACHE_MAX_RUN) {
+            k_memcpy(bufData[grab(dev, lba + i)], sec, BLOCKDEV_SECTOR_SIZE);
+            stats.misses++;
+        } else {
+            stats.bypassed++;
+        }
+    }
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Write
+// ------------------------------------------------------------
+int bcache_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    const uint8_t *src = (const uint8_t *)buf;
+
+    if (!dev || !count) return 0;
+    if (lba + count > dev->sectorCount) return 0;
+    if (!ready) bcache_setup();
+
+    // long transfers go through; cached copies of the range are dropped
+    if (count > BCACHE_MAX_RUN) {
+        for (uint32_t i = 0; i < count; i++) {
+            int idx = lookup(dev, lba + i);
+            if (idx == BCACHE_NONE) continue;
+
+            unhash(idx);
+            lru_demote(idx);
+        }
+        stats.bypassed += count;
+        return blkq_write(dev, lba, count, buf);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int idx = lookup(dev, lba + i);
+
+        if (idx == BCACHE_NONE) idx = grab(dev, lba + i);
+        else lru_touch(idx);
+
+        k_memcpy(bufData[idx], src + i * BLOCKDEV_SECTOR_SIZE, BLOCKDEV_SECTOR_SIZE);
+        bufs[idx].dirty = 1;
+    }
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Write-back / sync
+// ------------------------------------------------------------
+int bcache_writeback(BlockDevice *dev) {
+    int ok = 1;
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        if (!bufs[i].dev || !bufs[i].dirty) continue;
+        if (dev && bufs[i].dev != dev) continue;
+
+        if (!write_back(i)) ok = 0;
+    }
+
+    // the queue sorts and merges what was just handed to it
+    if (!blkq_drain(dev)) ok = 0;
+    return ok;
+}
+
+int bcache_sync(BlockDevice *dev) {
+    int ok = bcache_writeback(dev);
+
+    if (dev)
+        return blockdev_flush(dev) && ok;
+
+    for (int i = 0; i < blockdev_count(); i++)
+        if (!blockdev_flush(blockdev_get(i)))
+            ok = 0;
+    return ok;
+}
+
+// ------------------------------------------------------------
+// Overlay: newer copies over a read that went past the cache
+// ------------------------------------------------------------
+void bcache_overlay(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    uint8_t *dst = (uint8_t *)buf;
+
+    blkq_overlay(dev, lba, count, buf);
+    if (!ready) return;
+
+    for (uint32_t i = 0; i < count; i++, dst += BLOCKDEV_SECTOR_SIZE) {
+        int idx = lookup(dev, lba + i);
+        if (idx != BCACHE_NONE && bufs[idx].dirty)
+            k_memcpy(dst, bufData[idx], BLOCKDEV_SECTOR_SIZE);
+    }
+}
+
+void bcache_get_stats(BcacheStats *out) {
+    *out = stats;
+    out->cached = 0;
+    out->dirty = 0;
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        if (!bufs[i].dev) continue;
+        out->cached++;
+        if (bufs[i].dirty) out->dirty++;
+    }
+}
@@ -0,0 +1,202 @@
+#include "blkq.h"
+#include "string.h"
+
+// Pending sector writes, kept sorted by (device, LBA) so a drain is a
+// single elevator sweep
+typedef struct {
+    BlockDevice *dev;
+    uint32_t     lba;
+    uint8_t      slot;          // index into slotData
+} BlkqEntry;
+
+static BlkqEntry pending[BLKQ_DEPTH];
+static int pendingCount = 0;
+
+static uint8_t slotData[BLKQ_DEPTH][BLOCKDEV_SECTOR_SIZE];
+static uint8_t slotUsed[BLKQ_DEPTH];
+
+// A merged run is gathered here so it can go out as one command
+static uint8_t staging[BLKQ_DEPTH * BLOCKDEV_SECTOR_SIZE];
+
+static BlkqStats stats;
+
+// ------------------------------------------------------------
+// Sorted-array helpers
+// ------------------------------------------------------------
+static int key_less(BlockDevice *da, uint32_t la, BlockDevice *db, uint32_t lb) {
+    if (da != db) return (uint32_t)da < (uint32_t)db;
+    return la < lb;
+}
+
+// Index of (dev, lba) if pending, else the insertion point encoded as -(pos + 1)
+static int find_pending(BlockDevice *dev, uint32_t lba) {
+    int lo = 0, hi = pendingCount;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_less(pending[mid].dev, pending[mid].lba, dev, lba))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < pendingCount && pending[lo].dev == dev && pending[lo].lba == lba)
+        return lo;
+    return -(lo + 1);
+}
+
+static int alloc_slot() {
+    for (int i = 0; i < BLKQ_DEPTH; i++) {
+        if (!slotUsed[i]) {
+            slotUsed[i] = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// ------------------------------------------------------------
+// Drain: walk the sorted list and coalesce adjacent LBAs
+// ------------------------------------------------------------
+int blkq_drain(BlockDevice *dev) {
+    int ok = 1;
+    int keep = 0;
+    int i = 0;
+
+    if (pendingCount == 0)
+        return 1;
+
+    stats.drains++;
+
+    while (i < pendingCount) {
+        BlkqEntry *e = &pending[i];
+
+        if (dev && e->dev != dev) {
+            pending[keep++] = *e;
+            i++;
+            continue;
+        }
+
+        // gather the run [i, j) of back-to-back sectors
+        int j = i;
+        uint8_t *dst = staging;
+        while (j < pendingCount &&
+               pending[j].dev == e->dev &&
+               pending[j].lba == e->lba + (uint32_t)(j - i)) {
+            k_memcpy(dst, slotData[pending[j].slot], BLOCKDEV_SECTOR_SIZE);
+            dst += BLOCKDEV_SECTOR_SIZE;
+            slotUsed[pending[j].slot] = 0;
+            j++;
+        }
+
+        if (!blockdev_write(e->dev, e->lba, j - i, staging))
+            ok = 0;
+
+        stats.commands++;
+        stats.merged += j - i - 1;
+        i = j;
+    }
+
+    pendingCount = keep;
+    stats.depth = pendingCount;
+    return ok;
+}
+
+// ------------------------------------------------------------
+// Write: queue each sector, replacing a pending copy if there is one
+// ------------------------------------------------------------
+int blkq_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    const uint8_t *src = (const uint8_t *)buf;
+
+    if (!dev || !count) return 0;
+    if (lba + count > dev->sectorCount) return 0;
+
+    // big transfers are already one command; keep older writes ahead of them
+    if (count > BLKQ_BYPASS) {
+        if (!blkq_drain(dev)) return 0;
+        stats.bypassed += count;
+        return blockdev_write(dev, lba, count, buf);
+    }
+
+    for (uint32_t i = 0; i < count; i++, src += BLOCKDEV_SECTOR_SIZE) {
+        int pos = find_pending(dev, lba + i);
+
+        if (pos >= 0) {
+            k_memcpy(slotData[pending[pos].slot], src, BLOCKDEV_SECTOR_SIZE);
+            stats.absorbed++;
+            continue;
+        }
+
+        if (pendingCount == BLKQ_DEPTH) {
+            if (!blkq_drain(0)) return 0;
+            pos = -1;           // queue is empty now
+        }
+        pos = -pos - 1;
+
+        int slot = alloc_slot();
+        k_memcpy(slotData[slot], src, BLOCKDEV_SECTOR_SIZE);
+
+        for (int k = pendingCount; k > pos; k--)
+            pending[k] = pending[k - 1];
+        pending[pos].dev  = dev;
+        pending[pos].lba  = lba + i;
+        pending[pos].slot = (uint8_t)slot;
+        pendingCount++;
+
+        stats.queued++;
+    }
+
+    stats.depth = pendingCount;
+    if (stats.depth > stats.maxDepth)
+        stats.maxDepth = stats.depth;
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Read: served from the queue when it holds every sector, straight
+// from the device when it holds none, after a drain otherwise
+// ------------------------------------------------------------
+int blkq_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    uint32_t hits = 0;
+
+    if (!dev || !count) return 0;
+
+    if (pendingCount) {
+        for (uint32_t i = 0; i < count; i++)
+            if (find_pending(dev, lba + i) >= 0)
+                hits++;
+    }
+
+    if (hits == 0)
+        return blockdev_read(dev, lba, count, buf);
+
+    if (hits == count) {
+        uint8_t *dst = (uint8_t *)buf;
+        for (uint32_t i = 0; i < count; i++, dst += BLOCKDEV_SECTOR_SIZE)
+            k_memcpy(dst, slotData[pending[find_pending(dev, lba + i)].slot],
+                     BLOCKDEV_SECTOR_SIZE);
+        stats.readHits += count;
+        return 1;
+    }
+
+    if (!blkq_drain(dev)) return 0;
+    return blockdev_read(dev, lba, count, buf);
+}
+
+void blkq_overlay(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    uint8_t *dst = (uint8_t *)buf;
+
+    if (!pendingCount) return;
+
+    for (uint32_t i = 0; i < count; i++, dst += BLOCKDEV_SECTOR_SIZE) {
+        int pos = find_pending(dev, lba + i);
+        if (pos < 0) continue;
+
+        k_memcpy(dst, slotData[pending[pos].slot], BLOCKDEV_SECTOR_SIZE);
+        stats.readHits++;
+    }
+}
+
+void blkq_get_stats(BlkqStats *out) {
+    *out = stats;
+}
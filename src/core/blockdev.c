@@ -0,0 +1,112 @@
+#include "blockdev.h"
+#include "string.h"
+
+static BlockDevice *devices[BLOCKDEV_MAX];
+static int deviceCount = 0;
+
+int blockdev_register(BlockDevice *dev) {
+    if (deviceCount >= BLOCKDEV_MAX)
+        return 0;
+
+    if (!dev->sectorSize)
+        dev->sectorSize = BLOCKDEV_SECTOR_SIZE;
+
+    devices[deviceCount++] = dev;
+    return 1;
+}
+
+int blockdev_count() {
+    return deviceCount;
+}
+
+BlockDevice *blockdev_get(int index) {
+    if (index < 0 || index >= deviceCount)
+        return 0;
+    return devices[index];
+}
+
+BlockDevice *blockdev_find(const char *name) {
+    for (int i = 0; i < deviceCount; i++)
+        if (!k_strcmp(devices[i]->name, name))
+            return devices[i];
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Range-checked dispatch to the driver
+// ------------------------------------------------------------
+int blockdev_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    if (!dev || !count) return 0;
+    if (lba + count > dev->sectorCount) return 0;
+    return dev->ops->read(dev, lba, count, buf);
+}
+
+int blockdev_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    if (!dev || !count) return 0;
+    if (lba + count > dev->sectorCount) return 0;
+    return dev->ops->write(dev, lba, count, buf);
+}
+
+int blockdev_flush(BlockDevice *dev) {
+    if (!dev) return 0;
+    if (!dev->ops->flush) return 1;
+    return dev->ops->flush(dev);
+}
+
+// ------------------------------------------------------------
+// Asynchronous requests
+// ------------------------------------------------------------
+static void blockdev_complete(BlockRequest *req, int ok) {
+    req->status = ok ? BLKREQ_DONE : BLKREQ_ERROR;
+    if (req->done)
+        req->done(req);
+}
+
+int blockdev_submit(BlockRequest *req) {
+    BlockDevice *dev = req->dev;
+
+    if (!dev || !req->count) return 0;
+    if (req->lba + req->count > dev->sectorCount) return 0;
+
+    req->status = BLKREQ_PENDING;
+    req->tag = -1;
+
+    if (dev->ops->submit && dev->ops->submit(dev, req))
+        return 1;
+
+    // no queue (or it is full): do the transfer now
+    int ok = req->write
+        ? dev->ops->write(dev, req->lba, req->count, req->buf)
+        : dev->ops->read(dev, req->lba, req->count, req->buf);
+
+    blockdev_complete(req, ok);
+    return 1;
+}
+
+// Everything is issued before anything is waited on, so a device with
+// a command queue sees the whole batch at once
+int blockdev_submit_batch(BlockRequest *reqs, int n) {
+    int ok = 1;
+
+    for (int i = 0; i < n; i++)
+        if (!blockdev_submit(&reqs[i]))
+            ok = 0;
+    return ok;
+}
+
+int blockdev_poll(BlockRequest *req) {
+    if (req->status != BLKREQ_PENDING)
+        return req->status;
+
+    int r = req->dev->ops->poll(req->dev, req);
+    if (r)
+        blockdev_complete(req, r > 0);
+    return r;
+}
+
+int blockdev_wait(BlockRequest *req) {
+    if (req->status == BLKREQ_PENDING)
+        blockdev_complete(req, req->dev->ops->wait(req->dev, req));
+
+    return req->status == BLKREQ_DONE;
+}
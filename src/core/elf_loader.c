@@ -4,13 +4,27 @@
 #include "string.h"
 
 #define EXEC_BASE 0x01000000   // ELF loading physical address
+#define ELF_MAX_PHDRS 16
+
+// Header, program headers and segments all come through one handle
+static int elf_read_at(int fd, void *buf, uint32_t size, uint32_t offset) {
+    return fat16_lseek(fd, offset, FAT16_SEEK_SET) == (int)offset &&
+           fat16_read(fd, buf, size) == (int)size;
+}
 
 int elf_load(const char *filename) {
     Elf32_Ehdr hdr;
 
+    int fd = fat16_open(filename, FAT16_O_READ);
+    if (fd < 0) {
+        terminal_write_line("ELF: failed to open file");
+        return 0;
+    }
+
     // Read ELF header
-    if (fat16_read_partial(filename, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+    if (!elf_read_at(fd, &hdr, sizeof(hdr), 0)) {
         terminal_write_line("ELF: failed to read header");
+        fat16_close(fd);
         return 0;
     }
 
@@ -18,28 +32,38 @@ int elf_load(const char *filename) {
     if (hdr.e_ident[0] != 0x7F || hdr.e_ident[1] != 'E' ||
         hdr.e_ident[2] != 'L' || hdr.e_ident[3] != 'F') {
         terminal_write_line("ELF: invalid format");
+        fat16_close(fd);
         return 0;
     }
 
-    // Load program headers
-    for (int i = 0; i < hdr.e_phnum; i++) {
+    // Program header table in one read
+    Elf32_Phdr phdrs[ELF_MAX_PHDRS];
+    uint32_t phSize = hdr.e_phnum * sizeof(Elf32_Phdr);
 
-        Elf32_Phdr ph;
-        uint32_t phOffset = hdr.e_phoff + i * hdr.e_phentsize;
+    if (hdr.e_phnum > ELF_MAX_PHDRS || hdr.e_phentsize != sizeof(Elf32_Phdr) ||
+        !elf_read_at(fd, phdrs, phSize, hdr.e_phoff)) {
+        terminal_write_line("ELF: bad program headers");
+        fat16_close(fd);
+        return 0;
+    }
 
-        fat16_read_partial(filename, &ph, sizeof(ph), phOffset);
+    // Load segments; each read keeps several cluster runs in flight
+    for (int i = 0; i < hdr.e_phnum; i++) {
+        Elf32_Phdr *ph = &phdrs[i];
 
-        if (ph.p_type != PT_LOAD) continue;
+        if (ph->p_type != PT_LOAD) continue;
 
-        uint8_t *dest = (uint8_t*)(ph.p_vaddr);
+        uint8_t *dest = (uint8_t*)(ph->p_vaddr);
 
         // load segment
-        fat16_read_partial(filename, dest, ph.p_filesz, ph.p_offset);
+        elf_read_at(fd, dest, ph->p_filesz, ph->p_offset);
 
         // zero BSS
-        k_memset(dest + ph.p_filesz, 0, ph.p_memsz - ph.p_filesz);
+        k_memset(dest + ph->p_filesz, 0, ph->p_memsz - ph->p_filesz);
     }
 
+    fat16_close(fd);
+
     // Jump to entry point
     void (*entry)() = (void(*)()) (hdr.e_entry);
 
@@ -1,16 +1,222 @@
 #include "fat16.h"
-#include "ide.h"
+#include "blockdev.h"
+#include "bcache.h"
+#include "pcache.h"
 #include "terminal.h"
 #include "string.h"
+#include "irq.h"
 
 #define FAT16_EOC      0xFFFF
 #define FAT16_FREE     0x0000
 
-static Fat16BPB bpb;                 // boot sector ( BPB )
-static uint16_t fatTable[65536];     // supports up to 65536 clusters
-
-static uint32_t rootDirStartLBA;
-static uint32_t dataStartLBA;
+// Directory lookups remembered by the dentry cache
+#define FAT16_DCACHE_SIZE    128
+
+// Cluster-run reads fat16_read_chain keeps outstanding
+#define FAT16_READ_INFLIGHT  8
+
+// Extents remembered per open file
+#define FAT16_MAX_EXTENTS    32
+
+// Sequential readahead: streams tracked, and the window in sectors
+// (doubles from MIN up to MAX while a file is read front to back)
+#define FAT16_RA_STREAMS     8
+#define FAT16_RA_MIN         8
+#define FAT16_RA_MAX         64
+
+// Boot prefetch log: clusters of the boot volume read during the first
+// commands / seconds of a session, replayed into the page cache at boot
+#define FAT16_BOOTLOG_NAME      "PREFETCH.DAT"
+#define FAT16_BOOTLOG_MAGIC     0x4C465042      // "BPFL"
+#define FAT16_BOOTLOG_MAX       1024
+#define FAT16_BOOTLOG_COMMANDS  16
+#define FAT16_BOOTLOG_SECONDS   60
+
+// Delayed allocation: data written past the end of a file is held here
+// and gets its clusters only when it is flushed. One buffer per file;
+// together they fill 0x300000 - 0x3FFFFF, which is reserved: above the
+// user program area and syscall table, below RAMDISK_BASE (0x400000)
+#define FAT16_DELAY_FILES       8
+#define FAT16_DELAY_BASE        0x00300000
+#define FAT16_DELAY_BYTES       (128 * 1024)
+
+// FAT sectors are paged in on demand; this many stay resident,
+// shared by all volumes
+#define FAT16_FAT_CACHE_SECTORS 16
+#define FAT16_FAT_MAX_SECTORS   256
+
+// FAT entries the largest FAT can hold
+#define FAT16_MAX_CLUSTERS    (FAT16_FAT_MAX_SECTORS * 256)
+
+// Free-space summary in reserved sector 1, laid out like FAT32's FSInfo
+#define FSINFO_SECTOR         1
+#define FSINFO_LEAD_SIG       0x41615252
+#define FSINFO_STRUCT_SIG     0x61417272
+#define FSINFO_TRAIL_SIG      0xAA550000
+#define FSINFO_UNKNOWN        0xFFFFFFFF
+
+// MBR partition types that carry FAT16
+#define MBR_TYPE_FAT16_SMALL  0x04
+#define MBR_TYPE_FAT16        0x06
+#define MBR_TYPE_FAT16_LBA    0x0E
+
+// One mounted FAT16 volume (a whole disk or an MBR partition)
+typedef struct {
+    int          mounted;
+    BlockDevice *dev;               // device the volume lives on
+    uint32_t     partStart;         // first LBA of the volume on dev
+    uint32_t     partSectors;
+    Fat16BPB     bpb;               // boot sector ( BPB )
+    uint32_t     clusterCount;      // data clusters (2 .. clusterCount + 1)
+    uint32_t     rootDirStartLBA;   // volume-relative
+    uint32_t     dataStartLBA;      // volume-relative
+    uint16_t     cwd;               // current directory cluster, 0 = root
+
+    // cwd as a path from the root: cluster and name of each level,
+    // kept by fat16_cd / fat16_rename so the prompt needs no disk I/O
+    // Levels past FAT16_MAX_DEPTH are only counted in `extra` and are
+    // left through their ".." entries.
+    int          depth;
+    int          extra;
+    uint16_t     pathCluster[FAT16_MAX_DEPTH];
+    char         pathName[FAT16_MAX_DEPTH][13];
+
+    // FAT sectors written to copy #1 since the last fat_mirror,
+    // one bit per sector
+    uint32_t     mirrorDirty[FAT16_FAT_MAX_SECTORS / 32];
+    uint32_t     fatWrites;         // FAT sectors written to copy #1
+    uint32_t     mirrorWrites;      // FAT sectors written to the other copies
+
+    // one bit per cluster, set = free; filled in one FAT sector at a
+    // time as allocation reaches it (freeMapSectors says which are in)
+    // and kept in step with the FAT by fat_set
+    uint32_t     freeMap[FAT16_MAX_CLUSTERS / 32];
+    uint32_t     freeMapSectors[FAT16_FAT_MAX_SECTORS / 32];
+    uint32_t     allocHint;         // next-fit cursor for fat_alloc_cluster
+    uint32_t     freeCount;         // FSINFO_UNKNOWN until counted
+
+    int          hasFsInfo;         // reserved sector 1 carries the summary
+    int          fsInfoClean;       // on-disk summary is valid and current
+} Fat16Volume;
+
+static Fat16Volume volumes[FAT16_MAX_VOLUMES];
+static int volumeCount = 0;
+
+// Volume every fat16_* call operates on
+static Fat16Volume *vol = &volumes[0];
+
+// Cached directory lookup (see fat16_find_entry)
+typedef struct {
+    Fat16Volume  *vol;              // 0 = empty slot
+    uint16_t      dir;
+    char          name[11];
+    uint8_t       found;            // 0 = negative entry
+    int           index;
+    uint32_t      lba;
+    Fat16DirEntry entry;
+} Fat16Dentry;
+
+static Fat16Dentry dcache[FAT16_DCACHE_SIZE];
+static uint32_t dcacheHits = 0;
+static uint32_t dcacheMisses = 0;
+
+// One resident FAT sector
+typedef struct {
+    Fat16Volume *vol;               // 0 = empty
+    uint16_t     sector;            // index within the FAT
+    uint8_t      dirty;
+    uint32_t     lastUse;
+} Fat16FatSlot;
+
+static Fat16FatSlot fatSlots[FAT16_FAT_CACHE_SECTORS];
+static uint16_t     fatSlotData[FAT16_FAT_CACHE_SECTORS][256];
+static uint32_t     fatClock = 0;
+static int          fatLastSlot = 0;
+
+// Per-file sequential read state, keyed by the file's first cluster
+typedef struct {
+    Fat16Volume *vol;               // 0 = empty
+    uint16_t     cluster;
+    uint32_t     next;              // offset the last read ended at
+    uint32_t     raEnd;             // end of what readahead has fetched
+    uint32_t     window;            // sectors; 0 = not sequential
+    uint32_t     lastUse;
+} Fat16Stream;
+
+// Run of back-to-back clusters of a file
+typedef struct {
+    uint16_t index;                 // file cluster number of the first one
+    uint16_t cl;
+    uint16_t len;
+} Fat16Extent;
+
+// Extent list of an open file, built on first use. It covers the first
+// `clusters` clusters of the chain; once `full`, later clusters are
+// reached by walking on from the last extent.
+typedef struct {
+    Fat16Extent ext[FAT16_MAX_EXTENTS];
+    int         count;
+    uint32_t    clusters;
+    uint8_t     built;
+    uint8_t     full;
+} Fat16ExtentMap;
+
+// Position in a file's cluster chain: `cl` holds the bytes from `base`
+typedef struct {
+    uint16_t        first;
+    uint16_t        cl;
+    uint32_t        base;
+    Fat16ExtentMap *map;            // 0 = walk the chain
+} Fat16Cursor;
+
+// Open file (see fat16_open)
+typedef struct {
+    Fat16Volume *vol;               // 0 = slot free
+    uint32_t     dirLBA;            // directory slot of the entry
+    int          dirIndex;
+    int          mode;              // FAT16_O_* flags
+    uint32_t     size;
+    uint32_t     pos;
+    Fat16Cursor  cur;
+    Fat16ExtentMap map;
+} Fat16File;
+
+static Fat16File files[FAT16_MAX_FILES];
+
+// Buffered tail of a file: bytes [diskSize, diskSize + len) are only in
+// memory; the directory entry on disk still says diskSize
+typedef struct {
+    Fat16Volume *vol;               // 0 = free
+    uint32_t     dirLBA;
+    int          dirIndex;
+    uint32_t     diskSize;
+    uint32_t     len;
+    uint32_t     lastUse;
+} Fat16Delay;
+
+static Fat16Delay delays[FAT16_DELAY_FILES];
+static uint32_t   delayClock = 0;
+
+static Fat16Stream streams[FAT16_RA_STREAMS];
+static uint32_t    raClock = 0;
+static uint8_t     raBuf[FAT16_RA_MAX * FAT16_SECTOR_SIZE];
+
+// On-disk layout of the boot prefetch log (clusters sorted ascending)
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint16_t cluster[FAT16_BOOTLOG_MAX];
+} Fat16BootLog;
+
+static Fat16BootLog bootLog;
+static Fat16Volume *bootVol = 0;
+static int          bootLogActive = 0;
+static uint32_t     bootLogStart = 0;
+static uint32_t     bootLogCommands = 0;
+
+// The list loaded at boot; an unchanged log is not written back
+static uint16_t     bootLogPrev[FAT16_BOOTLOG_MAX];
+static uint32_t     bootLogPrevCount = 0;
 
 
 // ============================================================
@@ -24,7 +230,19 @@ static void fat16_store_entry(uint32_t lba,
                               int index,
                               const Fat16DirEntry *entry);
 
+static void dcache_forget(uint32_t lba, int index, const char name83[11]);
+static void dcache_forget_dir(uint16_t dirCluster);
+
 static uint16_t fat_next(uint16_t cl);
+static uint32_t fat16_read_chain(Fat16Cursor *cur, uint32_t offset, void *buffer,
+                                 uint32_t size, uint32_t fileSize);
+static void bootlog_prefetch();
+static Fat16Delay *delay_find(uint32_t lba, int index);
+static int  delay_flush_slot(uint32_t lba, int index);
+static void delay_set_size(uint32_t lba, int index, uint32_t size);
+static int  delay_flush_all();
+static void fat_mirror();
+static void fat_count_free();
 
 int fat16_rename(const char *oldName, const char *newName);
 // ============================================================
@@ -33,90 +251,587 @@ int fat16_rename(const char *oldName, const char *newName);
 // ============================================================
 //  Read sector helper
 // ============================================================
+// Multi-sector helpers, routed through the buffer cache.
+// LBAs inside this file are relative to the current volume.
+static inline void read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    bcache_read(vol->dev, vol->partStart + lba, count, buf);
+}
+
+static void pcache_forget_sectors(uint32_t lba, uint32_t count);
+
+static inline void write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    pcache_forget_sectors(lba, count);
+    bcache_write(vol->dev, vol->partStart + lba, count, buf);
+}
+
 static inline void read_sector(uint32_t lba, void *buf) {
-    ide_read_sector(lba, buf);
+    read_sectors(lba, 1, buf);
 }
 
 static inline void write_sector(uint32_t lba, const void *buf) {
-    ide_write_sector(lba, buf);
+    write_sectors(lba, 1, buf);
 }
 
 // ============================================================
 //  FAT16 Initialization
 // ============================================================
-int fat16_init() {
+
+// Sanity-check a boot sector before trusting its BPB
+static int fat16_bpb_valid(const uint8_t *sector) {
+    const Fat16BPB *b = (const Fat16BPB *)(sector + 11);
+
+    if (sector[0] != 0xEB && sector[0] != 0xE9) return 0;
+    if (b->bytesPerSector != 512) return 0;
+    if (b->sectorsPerCluster == 0 ||
+        (b->sectorsPerCluster & (b->sectorsPerCluster - 1))) return 0;
+    if (b->reservedSectors == 0) return 0;
+    if (b->fatCount == 0 || b->fatCount > 2) return 0;
+    if (b->fatSize16 == 0 || b->rootEntryCount == 0) return 0;
+    return 1;
+}
+
+// Adopt the summary in reserved sector 1 if it carries the signatures.
+// Any other reserved sector belongs to the formatter or a boot loader
+// and is left alone; the volume then runs without a stored summary.
+static void fat16_load_fsinfo(Fat16Volume *v, const uint8_t *sector) {
+    const uint32_t *w = (const uint32_t *)sector;
+
+    if (w[0] != FSINFO_LEAD_SIG || w[121] != FSINFO_STRUCT_SIG ||
+        w[127] != FSINFO_TRAIL_SIG)
+        return;
+
+    v->hasFsInfo = 1;
+
+    uint32_t freeCount = w[122];
+    uint32_t hint = w[123];
+
+    if (hint >= 2 && hint < v->clusterCount + 2)
+        v->allocHint = hint;
+
+    if (freeCount != FSINFO_UNKNOWN && freeCount <= v->clusterCount) {
+        v->freeCount = freeCount;
+        v->fsInfoClean = 1;
+    }
+}
+
+static int fat16_mount_volume(BlockDevice *dev, uint32_t start, uint32_t sectors) {
     uint8_t sector[FAT16_SECTOR_SIZE];
 
-    // Load boot sector
-    read_sector(0, sector);
-    k_memcpy(&bpb, sector + 11, sizeof(Fat16BPB));
+    if (volumeCount >= FAT16_MAX_VOLUMES) {
+        terminal_write_line("[FAT16] Too many volumes");
+        return 0;
+    }
+
+    if (!blockdev_read(dev, start, 1, sector) || !fat16_bpb_valid(sector))
+        return 0;
+
+    Fat16Volume *v = &volumes[volumeCount];
+    k_memset(v, 0, sizeof(*v));
+    k_memcpy(&v->bpb, sector + 11, sizeof(Fat16BPB));
+
+    v->dev = dev;
+    v->partStart = start;
+    v->partSectors = sectors;
 
-    if (bpb.bytesPerSector != 512) {
-        terminal_write_line("[FAT16] Unsupported sector size");
+    if (v->bpb.fatSize16 > FAT16_FAT_MAX_SECTORS) {
+        terminal_write_line("[FAT16] FAT too large");
         return 0;
     }
 
     // Calculate FAT and data area positions
     uint32_t rootDirSectors =
-        ((bpb.rootEntryCount * 32) + (bpb.bytesPerSector - 1)) / bpb.bytesPerSector;
+        ((v->bpb.rootEntryCount * 32) + (v->bpb.bytesPerSector - 1)) / v->bpb.bytesPerSector;
+
+    v->rootDirStartLBA = v->bpb.reservedSectors + (v->bpb.fatSize16 * v->bpb.fatCount);
+    v->dataStartLBA    = v->rootDirStartLBA + rootDirSectors;
+
+    uint32_t total = v->bpb.totalSectors16 ? v->bpb.totalSectors16 : v->bpb.totalSectors32;
+    if (total > sectors) total = sectors;
+    if (total <= v->dataStartLBA) return 0;
+
+    // clusters addressable by both the data area and the FAT itself
+    v->clusterCount = (total - v->dataStartLBA) / v->bpb.sectorsPerCluster;
+    if (v->clusterCount > (uint32_t)v->bpb.fatSize16 * 256 - 2)
+        v->clusterCount = (uint32_t)v->bpb.fatSize16 * 256 - 2;
+
+    // The FAT itself is not read here; sectors are paged in as used.
+    // Free space comes from the summary, or is counted when first needed.
+    v->allocHint = 2;
+    v->freeCount = FSINFO_UNKNOWN;
+    if (v->bpb.reservedSectors > FSINFO_SECTOR &&
+        blockdev_read(dev, start + FSINFO_SECTOR, 1, sector))
+        fat16_load_fsinfo(v, sector);
+
+    v->cwd = 0;
+    v->mounted = 1;
+    volumeCount++;
+
+    terminal_printf("FAT16 volume %d: %s @ LBA %u, %u clusters\n",
+                    volumeCount - 1, dev->name, start, v->clusterCount);
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Mount every FAT16 volume on `dev`: either the whole disk
+// (superfloppy, BPB at LBA 0) or each FAT16 primary partition.
+// Returns the number of volumes mounted.
+// ------------------------------------------------------------
+int fat16_mount(BlockDevice *dev) {
+    uint8_t mbr[FAT16_SECTOR_SIZE];
+    int mounted = 0;
+
+    if (!dev) {
+        terminal_write_line("[FAT16] No block device");
+        return 0;
+    }
+
+    if (!blockdev_read(dev, 0, 1, mbr))
+        return 0;
+
+    if (fat16_bpb_valid(mbr))
+        return fat16_mount_volume(dev, 0, dev->sectorCount);
+
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA) {
+        terminal_write_line("[FAT16] No BPB or MBR found");
+        return 0;
+    }
 
-    rootDirStartLBA = bpb.reservedSectors + (bpb.fatSize16 * bpb.fatCount);
-    dataStartLBA    = rootDirStartLBA + rootDirSectors;
+    // four primary entries at 0x1BE (extended partitions are not followed)
+    for (int i = 0; i < 4; i++) {
+        const uint8_t *pe = mbr + 0x1BE + i * 16;
+        uint8_t  type    = pe[4];
+        uint32_t start   = pe[8]  | (pe[9] << 8)  | (pe[10] << 16) | ((uint32_t)pe[11] << 24);
+        uint32_t sectors = pe[12] | (pe[13] << 8) | (pe[14] << 16) | ((uint32_t)pe[15] << 24);
 
-    // Load FAT table (only first FAT)
-    for (uint32_t i = 0; i < bpb.fatSize16; i++) {
-        uint8_t sec[FAT16_SECTOR_SIZE];
-        read_sector(bpb.reservedSectors + i, sec);
-        k_memcpy(((uint8_t *)fatTable) + i * FAT16_SECTOR_SIZE, sec, FAT16_SECTOR_SIZE);
+        if (type != MBR_TYPE_FAT16_SMALL && type != MBR_TYPE_FAT16 &&
+            type != MBR_TYPE_FAT16_LBA)
+            continue;
+
+        if (start == 0 || start + sectors > dev->sectorCount)
+            continue;
+
+        mounted += fat16_mount_volume(dev, start, sectors);
     }
 
+    return mounted;
+}
+
+int fat16_init(BlockDevice *dev) {
+    int first = volumeCount;
+
+    if (!fat16_mount(dev))
+        return 0;
+
+    vol = &volumes[first];
     terminal_write_line("FAT16 initialized.");
+
+    // replay the last session's log, then record this one
+    bootVol = vol;
+    bootlog_prefetch();
+
+    bootLog.magic = FAT16_BOOTLOG_MAGIC;
+    bootLog.count = 0;
+    bootLogActive = 1;
+    bootLogStart = irq_ticks();
+    return 1;
+}
+
+// ============================================================
+// Volume selection
+// ============================================================
+int fat16_volume_count() {
+    return volumeCount;
+}
+
+int fat16_get_volume() {
+    return vol - volumes;
+}
+
+int fat16_set_volume(int index) {
+    if (index < 0 || index >= volumeCount)
+        return 0;
+    vol = &volumes[index];
+    return 1;
+}
+
+int fat16_volume_info(int index, Fat16VolumeInfo *out) {
+    if (index < 0 || index >= volumeCount)
+        return 0;
+
+    Fat16Volume *v = &volumes[index];
+
+    if (v->freeCount == FSINFO_UNKNOWN) {
+        Fat16Volume *cur = vol;
+        vol = v;
+        fat_count_free();
+        vol = cur;
+    }
+
+    out->deviceName   = v->dev->name;
+    out->startLBA     = v->partStart;
+    out->sectors      = v->partSectors;
+    out->clusterCount = v->clusterCount;
+    out->clusterSize  = v->bpb.sectorsPerCluster * FAT16_SECTOR_SIZE;
+    out->freeClusters = v->freeCount;
+    out->fatWrites    = v->fatWrites;
+    out->mirrorWrites = v->mirrorWrites;
     return 1;
 }
 
+int fat16_sync() {
+    Fat16Volume *cur = vol;
+    int ok = 1;
+
+    // buffered file data gets its clusters first
+    if (!delay_flush_all())
+        ok = 0;
+
+    for (int i = 0; i < volumeCount; i++) {
+        vol = &volumes[i];
+        fat_mirror();
+        if (!bcache_sync(vol->dev))
+            ok = 0;
+    }
+
+    vol = cur;
+    return ok;
+}
+
+// ============================================================
+// FAT sector cache
+// ============================================================
+
+// Write a resident FAT sector back to the first FAT of its volume
+static void fat_write_slot(int idx) {
+    Fat16FatSlot *f = &fatSlots[idx];
+    Fat16Volume *v = f->vol;
+
+    bcache_write(v->dev, v->partStart + v->bpb.reservedSectors + f->sector, 1,
+                 fatSlotData[idx]);
+
+    v->mirrorDirty[f->sector >> 5] |= 1u << (f->sector & 31);
+    v->fatWrites++;
+    f->dirty = 0;
+}
+
+// Slot holding FAT sector `sector` of the current volume, loading it
+// into the least recently used slot if needed
+static int fat_slot(uint32_t sector) {
+    Fat16FatSlot *f = &fatSlots[fatLastSlot];
+
+    if (f->vol == vol && f->sector == sector) {
+        f->lastUse = ++fatClock;
+        return fatLastSlot;
+    }
+
+    int victim = 0;
+    for (int i = 0; i < FAT16_FAT_CACHE_SECTORS; i++) {
+        f = &fatSlots[i];
+
+        if (f->vol == vol && f->sector == sector) {
+            f->lastUse = ++fatClock;
+            fatLastSlot = i;
+            return i;
+        }
+        if (f->lastUse < fatSlots[victim].lastUse)
+            victim = i;
+    }
+
+    f = &fatSlots[victim];
+    if (f->vol && f->dirty)
+        fat_write_slot(victim);
+
+    f->vol = vol;
+    f->sector = sector;
+    f->dirty = 0;
+    f->lastUse = ++fatClock;
+    read_sector(vol->bpb.reservedSectors + sector, fatSlotData[victim]);
+
+    fatLastSlot = victim;
+    return victim;
+}
+
 // ============================================================
 // FAT table helpers
 // ============================================================
+static void fat_write_fsinfo(int valid);
+
 static inline uint16_t fat_get(uint16_t cluster) {
-    return fatTable[cluster];
+    // 256 entries per FAT sector
+    return fatSlotData[fat_slot(cluster >> 8)][cluster & 255];
+}
+
+static void fat_set(uint16_t cluster, uint16_t value) {
+    int idx = fat_slot(cluster >> 8);
+    uint16_t old = fatSlotData[idx][cluster & 255];
+
+    fatSlotData[idx][cluster & 255] = value;
+    fatSlots[idx].dirty = 1;
+
+    // first change since the summary was last written: mark it stale
+    if (vol->hasFsInfo && vol->fsInfoClean)
+        fat_write_fsinfo(0);
+
+    if (vol->freeCount != FSINFO_UNKNOWN) {
+        if (old == FAT16_FREE && value != FAT16_FREE)
+            vol->freeCount--;
+        else if (old != FAT16_FREE && value == FAT16_FREE)
+            vol->freeCount++;
+    }
+
+    // a freed cluster's cached pages are dead
+    if (value == FAT16_FREE && old != FAT16_FREE)
+        pcache_invalidate(vol, cluster, 0, vol->bpb.sectorsPerCluster);
+
+    // sectors not in the bitmap yet are read from the FAT when they are
+    if (!((vol->freeMapSectors[cluster >> 13] >> ((cluster >> 8) & 31)) & 1))
+        return;
+
+    if (value == FAT16_FREE)
+        vol->freeMap[cluster >> 5] |= 1u << (cluster & 31);
+    else
+        vol->freeMap[cluster >> 5] &= ~(1u << (cluster & 31));
+}
+
+// Bring the 256 clusters of FAT sector `s` into the free bitmap
+static void fat_map_sector(uint32_t s) {
+    if ((vol->freeMapSectors[s >> 5] >> (s & 31)) & 1)
+        return;
+    vol->freeMapSectors[s >> 5] |= 1u << (s & 31);
+
+    const uint16_t *fat = fatSlotData[fat_slot(s)];
+    uint32_t end = vol->clusterCount + 2;
+
+    for (uint32_t c = s ? s * 256 : 2; c < (s + 1) * 256 && c < end; c++)
+        if (fat[c & 255] == FAT16_FREE)
+            vol->freeMap[c >> 5] |= 1u << (c & 31);
+}
+
+// Free count unknown (no valid summary): map the whole FAT and count
+static void fat_count_free() {
+    uint32_t end = vol->clusterCount + 2;
+
+    for (uint32_t s = 0; s * 256 < end; s++)
+        fat_map_sector(s);
+
+    vol->freeCount = 0;
+    for (uint32_t c = 2; c < end; c++)
+        if ((vol->freeMap[c >> 5] >> (c & 31)) & 1)
+            vol->freeCount++;
 }
 
-static inline void fat_set(uint16_t cluster, uint16_t value) {
-    fatTable[cluster] = value;
+// Write the free-space summary; `valid` = 0 stores "unknown" so a
+// crash before the next sync forces a recount at mount
+static void fat_write_fsinfo(int valid) {
+    uint32_t w[FAT16_SECTOR_SIZE / 4];
+
+    k_memset(w, 0, sizeof(w));
+    w[0]   = FSINFO_LEAD_SIG;
+    w[121] = FSINFO_STRUCT_SIG;
+    w[122] = valid ? vol->freeCount : FSINFO_UNKNOWN;
+    w[123] = vol->allocHint;
+    w[127] = FSINFO_TRAIL_SIG;
+
+    write_sector(FSINFO_SECTOR, w);
+    vol->fsInfoClean = valid;
 }
 
-// Write FAT back to disk
+// Write the current volume's changed FAT sectors to the first FAT.
+// Called once at the end of each operation that touches the FAT; the
+// other copies lag until fat_mirror.
 static void fat_flush() {
-    uint8_t buf[FAT16_SECTOR_SIZE];
+    for (int i = 0; i < FAT16_FAT_CACHE_SECTORS; i++)
+        if (fatSlots[i].vol == vol && fatSlots[i].dirty)
+            fat_write_slot(i);
+}
 
-    for (uint32_t i = 0; i < bpb.fatSize16; i++) {
-        k_memcpy(buf, ((uint8_t *)fatTable) + i * FAT16_SECTOR_SIZE, FAT16_SECTOR_SIZE);
+// Bring FAT copies #2.. in line with the first one (sync / unmount)
+static void fat_mirror() {
+    fat_flush();
+
+    for (uint32_t s = 0; s < vol->bpb.fatSize16; s++) {
+        if (!((vol->mirrorDirty[s >> 5] >> (s & 31)) & 1))
+            continue;
+
+        const uint16_t *data = fatSlotData[fat_slot(s)];
+        for (int c = 1; c < vol->bpb.fatCount; c++) {
+            write_sector(vol->bpb.reservedSectors + c * vol->bpb.fatSize16 + s, data);
+            vol->mirrorWrites++;
+        }
+    }
+    k_memset(vol->mirrorDirty, 0, sizeof(vol->mirrorDirty));
 
-        // write to both FATs
-        write_sector(bpb.reservedSectors + i, buf);
-        write_sector(bpb.reservedSectors + i + bpb.fatSize16, buf);
+    if (vol->hasFsInfo && !vol->fsInfoClean) {
+        if (vol->freeCount == FSINFO_UNKNOWN)
+            fat_count_free();
+        fat_write_fsinfo(1);
     }
 }
 
 // ============================================================
 // Allocate a free cluster
 // ============================================================
+// First free cluster in [from, end), or 0. Skips 32 clusters per
+// step over fully used words of the bitmap, mapping FAT sectors as
+// it reaches them.
+static uint16_t fat_scan_free(uint32_t from, uint32_t end) {
+    uint32_t c = from;
+
+    while (c < end) {
+        fat_map_sector(c >> 8);
+
+        uint32_t word = vol->freeMap[c >> 5] >> (c & 31);
+
+        if (word) {
+            c += __builtin_ctz(word);
+            return c < end ? c : 0;
+        }
+        c = (c | 31) + 1;
+    }
+    return 0;
+}
+
+// Next-fit: continue after the previous allocation, wrap once
 static uint16_t fat_alloc_cluster() {
-    for (uint16_t c = 2; c < 65535; c++) {
-        if (fat_get(c) == FAT16_FREE) {
-            fat_set(c, FAT16_EOC);
-            fat_flush();
-            return c;
+    uint32_t end = vol->clusterCount + 2;
+
+    uint16_t c = fat_scan_free(vol->allocHint, end);
+    if (!c) c = fat_scan_free(2, vol->allocHint);
+    if (!c) return 0;   // disk full
+
+    fat_set(c, FAT16_EOC);
+    vol->allocHint = (c + 1u < end) ? c + 1 : 2;
+    return c;
+}
+
+// Length of the free run starting at `c`, stopping at `end`
+static uint32_t fat_run_length(uint32_t c, uint32_t end) {
+    uint32_t start = c;
+
+    while (c < end) {
+        fat_map_sector(c >> 8);
+
+        if (!(c & 31) && vol->freeMap[c >> 5] == 0xFFFFFFFF) {
+            c += 32;
+            continue;
+        }
+        if (!(vol->freeMap[c >> 5] & (1u << (c & 31))))
+            break;
+        c++;
+    }
+    return (c < end ? c : end) - start;
+}
+
+// Free run to allocate `n` clusters from: the first one (next-fit from
+// allocHint) that holds all of them, else the largest. 0 if none.
+static uint32_t fat_find_run(uint32_t n, uint32_t *lenOut) {
+    uint32_t end = vol->clusterCount + 2;
+    uint32_t best = 0, bestLen = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t c = pass ? 2 : vol->allocHint;
+        uint32_t stop = pass ? vol->allocHint : end;
+
+        while ((c = fat_scan_free(c, stop)) != 0) {
+            uint32_t len = fat_run_length(c, stop);
+
+            if (len >= n) {
+                *lenOut = len;
+                return c;
+            }
+            if (len > bestLen) {
+                best = c;
+                bestLen = len;
+            }
+            c += len;
         }
     }
-    return 0;   // disk full
+
+    *lenOut = bestLen;
+    return best;
+}
+
+// Allocate `n` clusters as one chain, linked in order after `after`
+// (0 = a new chain). Runs are taken whole so the chain has as few
+// fragments as the free space allows; the run right after `after` is
+// used when it is long enough. Returns the first new cluster, 0 (with
+// nothing allocated) if there is not enough free space.
+static uint16_t fat_alloc_runs(uint32_t n, uint16_t after) {
+    uint32_t end = vol->clusterCount + 2;
+    uint16_t first = 0;
+    uint16_t last = after;
+
+    if (vol->freeCount == FSINFO_UNKNOWN)
+        fat_count_free();
+    if (!n || vol->freeCount < n)
+        return 0;
+
+    while (n) {
+        uint32_t len = 0;
+        uint32_t start = 0;
+
+        if (last && last + 1u < end)
+            len = fat_run_length(last + 1, end);
+
+        if (len >= n) start = last + 1;
+        else start = fat_find_run(n, &len);
+
+        // free map and count disagree: undo the partial chain
+        if (!len) {
+            for (uint16_t c = first; c; ) {
+                uint16_t next = fat_next(c);
+                fat_set(c, FAT16_FREE);
+                c = next;
+            }
+            if (after) fat_set(after, FAT16_EOC);
+            return 0;
+        }
+
+        if (len > n) len = n;
+
+        for (uint32_t c = start; c + 1 < start + len; c++)
+            fat_set(c, c + 1);
+        fat_set(start + len - 1, FAT16_EOC);
+
+        if (last) fat_set(last, start);
+        if (!first) first = start;
+
+        last = start + len - 1;
+        n -= len;
+        vol->allocHint = (last + 1u < end) ? last + 1 : 2;
+    }
+    return first;
 }
 
 // ============================================================
 // Cluster → LBA
 // ============================================================
 static inline uint32_t cluster_to_lba(uint16_t cl) {
-    return dataStartLBA + (cl - 2) * bpb.sectorsPerCluster;
+    return vol->dataStartLBA + (cl - 2) * vol->bpb.sectorsPerCluster;
+}
+
+// Writes into the data area replace whatever the page cache holds
+static void pcache_forget_sectors(uint32_t lba, uint32_t count) {
+    if (lba + count <= vol->dataStartLBA)
+        return;
+
+    if (lba < vol->dataStartLBA) {
+        count -= vol->dataStartLBA - lba;
+        lba = vol->dataStartLBA;
+    }
+
+    uint32_t spc = vol->bpb.sectorsPerCluster;
+    uint32_t rel = lba - vol->dataStartLBA;
+
+    while (count) {
+        uint32_t index = rel % spc;
+        uint32_t n = spc - index;
+        if (n > count) n = count;
+
+        pcache_invalidate(vol, rel / spc + 2, index, n);
+        rel += n;
+        count -= n;
+    }
 }
 
 // ============================================================
@@ -127,7 +842,7 @@ static void clear_cluster(uint16_t cl) {
     k_memset(zero, 0, FAT16_SECTOR_SIZE);
 
     uint32_t lba = cluster_to_lba(cl);
-    for (uint8_t i = 0; i < bpb.sectorsPerCluster; i++) {
+    for (uint8_t i = 0; i < vol->bpb.sectorsPerCluster; i++) {
         write_sector(lba + i, zero);
     }
 }
@@ -135,10 +850,10 @@ static void clear_cluster(uint16_t cl) {
 uint32_t fat16_entry_lba(uint16_t dirCluster, int entryIndex) {
     if (dirCluster == 0) {
         int sectorOffset = entryIndex / 16;  // 每 sector 16 entries
-        return rootDirStartLBA + sectorOffset;
+        return vol->rootDirStartLBA + sectorOffset;
     }
 
-    int entriesPerCluster = bpb.sectorsPerCluster * 16;
+    int entriesPerCluster = vol->bpb.sectorsPerCluster * 16;
     int clusterOffset = entryIndex / entriesPerCluster;
 
     uint16_t cl = dirCluster;
@@ -162,36 +877,125 @@ static uint16_t fat_next(uint16_t cl) {
     return n;
 }
 
-// ============================================================
-// Allocate new cluster and link chain
-// ============================================================
-static uint16_t fat_extend_chain(uint16_t lastCl) {
-    uint16_t newCl = fat_alloc_cluster();
-    if (!newCl) return 0;
+// ------------------------------------------------------------
+// Extent maps
+// ------------------------------------------------------------
+static void map_append(Fat16ExtentMap *m, uint16_t cl) {
+    Fat16Extent *last = m->count ? &m->ext[m->count - 1] : 0;
+
+    if (m->full) return;
+
+    if (last && last->cl + last->len == cl && last->len < 0xFFFF) {
+        last->len++;
+    } else if (m->count < FAT16_MAX_EXTENTS) {
+        last = &m->ext[m->count++];
+        last->index = m->clusters;
+        last->cl = cl;
+        last->len = 1;
+    } else {
+        m->full = 1;
+        return;
+    }
+    m->clusters++;
+}
 
-    fat_set(lastCl, newCl);
-    fat_flush();
-    clear_cluster(newCl);
+static void map_reset(Fat16ExtentMap *m) {
+    m->count = 0;
+    m->clusters = 0;
+    m->built = 0;
+    m->full = 0;
+}
 
-    return newCl;
+static void map_build(Fat16ExtentMap *m, uint16_t first) {
+    map_reset(m);
+    for (uint16_t cl = first; cl >= 2 && !m->full; cl = fat_next(cl))
+        map_append(m, cl);
+    m->built = 1;
 }
 
-// ============================================================
-// Read an entire cluster into buffer
-// ============================================================
-static void read_cluster(uint16_t cl, void *buf) {
-    uint32_t lba = cluster_to_lba(cl);
-    for (uint8_t i = 0; i < bpb.sectorsPerCluster; i++)
-        read_sector(lba + i, ((uint8_t *)buf) + i * FAT16_SECTOR_SIZE);
+// Drop clusters from file cluster `keep` on (the file shrank)
+static void map_truncate(Fat16ExtentMap *m, uint32_t keep) {
+    if (!m->built || keep >= m->clusters) return;
+
+    while (m->count && m->ext[m->count - 1].index >= keep)
+        m->count--;
+    if (m->count) {
+        Fat16Extent *last = &m->ext[m->count - 1];
+        last->len = keep - last->index;
+    }
+    m->clusters = keep;
+    m->full = 0;
 }
 
-// ============================================================
-// Write an entire cluster
-// ============================================================
-static void write_cluster(uint16_t cl, const void *buf) {
-    uint32_t lba = cluster_to_lba(cl);
-    for (uint8_t i = 0; i < bpb.sectorsPerCluster; i++)
-        write_sector(lba + i, ((uint8_t *)buf) + i * FAT16_SECTOR_SIZE);
+// Extent holding file cluster `index` (index < m->clusters)
+static const Fat16Extent *map_find(const Fat16ExtentMap *m, uint32_t index) {
+    int lo = 0, hi = m->count - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (m->ext[mid].index <= index) lo = mid;
+        else hi = mid - 1;
+    }
+    return &m->ext[lo];
+}
+
+// Cursor at the start of the chain from `first`, without an extent map
+static inline void cursor_init(Fat16Cursor *c, uint16_t first) {
+    c->first = first;
+    c->cl = first;
+    c->base = 0;
+    c->map = 0;
+}
+
+// Cluster holding byte `offset` of the chain. With an extent map the
+// cluster is found by binary search; past the mapped part (or without
+// one) the walk goes on from the cursor unless it is already past
+// `offset`. 0 if the chain ends first; the cursor is then left on the
+// last cluster.
+static uint16_t cursor_seek(Fat16Cursor *c, uint32_t offset) {
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+    uint32_t index = offset / clusterSize;
+    Fat16ExtentMap *m = c->map;
+
+    if (m && !m->built)
+        map_build(m, c->first);
+
+    if (m && m->clusters) {
+        uint32_t at = index < m->clusters ? index : m->clusters - 1;
+
+        // jump unless the cursor is already between there and offset
+        if (c->cl < 2 || c->base < at * clusterSize || c->base > offset) {
+            const Fat16Extent *x = map_find(m, at);
+            c->cl = x->cl + (at - x->index);
+            c->base = at * clusterSize;
+        }
+    }
+
+    if (c->cl < 2 || offset < c->base) {
+        c->cl = c->first;
+        c->base = 0;
+    }
+    if (c->cl < 2) return 0;
+
+    while (offset - c->base >= clusterSize) {
+        uint16_t next = fat_next(c->cl);
+        if (!next) return 0;
+        c->cl = next;
+        c->base += clusterSize;
+    }
+    return c->cl;
+}
+
+// Number of clusters (up to max) starting at cl that sit back-to-back on disk
+static uint32_t fat_contiguous_run(uint16_t cl, uint32_t max) {
+    uint32_t n = 1;
+    while (n < max) {
+        uint16_t next = fat_next(cl);
+        if (next != (uint16_t)(cl + 1)) break;
+        cl = next;
+        n++;
+    }
+    return n;
 }
 
 // Load a single directory entry block (512 bytes)
@@ -254,78 +1058,95 @@ void fat16_protect_kernel() {
 }
 
 // ------------------------------------------------------------
-// Load entire directory (root or subdirectory)
+// Directory iterator (root or subdirectory), one sector at a time
 // ------------------------------------------------------------
 // dirCluster == 0  → root directory
 // dirCluster >= 2  → subdirectory in clusters
-int fat16_load_directory(uint16_t dirCluster, Fat16DirEntry *out, int max) {
-    int count = 0;
+void fat16_opendir(Fat16Dir *d, uint16_t dirCluster) {
+    d->vol = vol;
+    d->cluster = dirCluster;
+    d->sector = 0;
+    d->lba = 0;
+    d->slot = 16;           // nothing loaded yet
+    d->done = 0;
+}
 
-    if (dirCluster == 0) {
+void fat16_closedir(Fat16Dir *d) {
+    d->done = 1;
+}
+
+// Load the next directory sector; 0 past the end of the directory
+static int dir_load_next(Fat16Dir *d) {
+    if (d->cluster == 0) {
         // root directory is fixed area, not cluster based
-        uint32_t rootEntries = bpb.rootEntryCount;
-        uint32_t sectors = ((rootEntries * 32) + 511) / 512;
+        uint32_t sectors = ((vol->bpb.rootEntryCount * 32) + 511) / 512;
+        if (d->sector >= sectors)
+            return 0;
+        d->lba = vol->rootDirStartLBA + d->sector;
+    } else {
+        if (d->sector >= vol->bpb.sectorsPerCluster) {
+            d->cluster = fat_next(d->cluster);
+            d->sector = 0;
+        }
+        if (d->cluster < 2)
+            return 0;
+        d->lba = cluster_to_lba(d->cluster) + d->sector;
+    }
 
-        for (uint32_t i = 0; i < sectors; i++) {
-            Fat16DirEntry block[16];
-            uint32_t lba = rootDirStartLBA + i;
+    load_dir_sector(d->lba, d->block);
+    d->sector++;
+    d->slot = 0;
+    return 1;
+}
 
-            load_dir_sector(lba, block);
+// Next used entry as stored on disk
+static const Fat16DirEntry *dir_next(Fat16Dir *d) {
+    if (d->vol != vol) d->done = 1;     // volume switched underneath
 
-            for (int j = 0; j < 16; j++) {
-                uint8_t first = block[j].name[0];
+    while (!d->done) {
+        if (d->slot == 16 && !dir_load_next(d))
+            break;
 
-                if (first == 0x00) {
-                    return count;
-                }
-                // deleted
-                if (first == 0xE5)
-                    continue;
+        const Fat16DirEntry *e = &d->block[d->slot++];
 
-                // LFN
-                if (block[j].attr == FAT16_ATTR_LFN)
-                    continue;
+        if (e->name[0] == 0x00) break;          // end of directory
+        if ((uint8_t)e->name[0] == 0xE5) continue;  // deleted
+        if (e->attr == FAT16_ATTR_LFN) continue;
 
-                // valid
-                if (count < max)
-                    out[count++] = block[j];
-            }
-        }
-        return count;
+        return e;
     }
 
-    // -----------------------------
-    // Subdirectory (cluster chain)
-    // -----------------------------
-    uint16_t cl = dirCluster;
-
-    while (cl >= 2 && count < max) {
-        Fat16DirEntry block[16];
-
-        uint32_t lba = cluster_to_lba(cl);
-
-        for (uint8_t s = 0; s < bpb.sectorsPerCluster; s++) {
-            load_dir_sector(lba + s, block);
+    d->done = 1;
+    return 0;
+}
 
-            for (int j = 0; j < 16; j++) {
+int fat16_readdir(Fat16Dir *d, Fat16DirEntry *out, uint32_t *outLBA, int *outIndex) {
+    const Fat16DirEntry *e = dir_next(d);
+    if (!e) return 0;
 
-                uint8_t first = block[j].name[0];
+    int index = d->slot - 1;
 
-                if (first == 0x00) {
-                    return count;   // STOP EVERYTHING
-                }
+    if (out) {
+        *out = *e;
 
-                if (first == 0xE5) continue;
-                if (block[j].attr == FAT16_ATTR_LFN) continue;
+        // size as written so far, buffered bytes included
+        Fat16Delay *dl = delay_find(d->lba, index);
+        if (dl) out->size = dl->diskSize + dl->len;
+    }
+    if (outLBA) *outLBA = d->lba;
+    if (outIndex) *outIndex = index;
+    return 1;
+}
 
-                if (count < max)
-                    out[count++] = block[j];
-            }
-        }
+// Copy up to `max` entries into `out`
+int fat16_load_directory(uint16_t dirCluster, Fat16DirEntry *out, int max) {
+    Fat16Dir d;
+    int count = 0;
 
-        // next cluster
-        cl = fat_next(cl);
-    }
+    fat16_opendir(&d, dirCluster);
+    while (count < max && fat16_readdir(&d, &out[count], 0, 0))
+        count++;
+    fat16_closedir(&d);
 
     return count;
 }
@@ -335,20 +1156,20 @@ int fat16_load_directory(uint16_t dirCluster, Fat16DirEntry *out, int max) {
 // Returns index in directory or -1 if not found
 // ------------------------------------------------------------
 int fat16_find_in_directory(uint16_t dirCluster, const char *name) {
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(dirCluster, entries, 256);
+    Fat16Dir d;
+    const Fat16DirEntry *e;
+    int i = 0;
 
     char search83[11];
     fat16_format_83(search83, name);
 
-    for (int i = 0; i < n; i++) {
-        if (entries[i].name[0] == 0x00) break;
-        if (entries[i].name[0] == 0xE5) continue;
-        if (entries[i].attr == FAT16_ATTR_LFN) continue;
-
-        if (!k_memcmp(entries[i].name, search83, 11)) {
+    fat16_opendir(&d, dirCluster);
+    while ((e = dir_next(&d)) != 0) {
+        if (!k_memcmp(e->name, search83, 11)) {
+            fat16_closedir(&d);
             return i;
         }
+        i++;
     }
     return -1;
 }
@@ -357,18 +1178,12 @@ int fat16_find_in_directory(uint16_t dirCluster, const char *name) {
 // List directory contents
 // ------------------------------------------------------------
 void fat16_list_directory(uint16_t dirCluster) {
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(dirCluster, entries, 256);
-
+    Fat16Dir d;
+    const Fat16DirEntry *e;
     char temp[13];
 
-    for (int i = 0; i < n; i++) {
-        Fat16DirEntry *e = &entries[i];
-
-        if (e->name[0] == 0x00) break;
-        if (e->name[0] == 0xE5) continue;
-        if (e->attr == FAT16_ATTR_LFN) continue;
-
+    fat16_opendir(&d, dirCluster);
+    while ((e = dir_next(&d)) != 0) {
         // Convert 8.3 name to regular string
         fat16_decode_name(temp, e->name);
 
@@ -385,15 +1200,15 @@ static int fat16_find_free_entry(uint16_t dirCluster, uint32_t *outLBA, int *out
 
     if (dirCluster == 0) {
         // root directory
-        uint32_t rootEntries = bpb.rootEntryCount;
+        uint32_t rootEntries = vol->bpb.rootEntryCount;
         uint32_t sectors = ((rootEntries * 32) + 511) / 512;
 
         for (uint32_t i = 0; i < sectors; i++) {
-            uint32_t lba = rootDirStartLBA + i;
+            uint32_t lba = vol->rootDirStartLBA + i;
             load_dir_sector(lba, block);
 
             for (int j = 0; j < 16; j++) {
-                if (block[j].name[0] == 0x00 || block[j].name[0] == 0xE5) {
+                if (block[j].name[0] == 0x00 || (uint8_t)block[j].name[0] == 0xE5) {
                     *outLBA = lba;
                     *outIndex = j;
                     return 1;
@@ -408,11 +1223,11 @@ static int fat16_find_free_entry(uint16_t dirCluster, uint32_t *outLBA, int *out
     while (cl >= 2) {
         uint32_t lba = cluster_to_lba(cl);
 
-        for (uint8_t i = 0; i < bpb.sectorsPerCluster; i++) {
+        for (uint8_t i = 0; i < vol->bpb.sectorsPerCluster; i++) {
             load_dir_sector(lba + i, block);
 
             for (int j = 0; j < 16; j++) {
-                if (block[j].name[0] == 0x00 || block[j].name[0] == 0xE5) {
+                if (block[j].name[0] == 0x00 || (uint8_t)block[j].name[0] == 0xE5) {
                     *outLBA = lba + i;
                     *outIndex = j;
                     return 1;
@@ -441,20 +1256,95 @@ int fat16_write_entry(uint16_t dirCluster, const Fat16DirEntry *newEntry) {
     block[index] = *newEntry;
 
     save_dir_sector(lba, block);
+
+    dcache_forget(lba, index, newEntry->name);
     return 1;
 }
 
-// current working directory cluster
+// current working directory cluster of the current volume
 // 0 = root
-uint16_t currentDirCluster = 0;
 
 // external accessor for shell
 uint16_t fat16_get_cwd() {
-    return currentDirCluster;
+    return vol->cwd;
 }
 
-void fat16_set_cwd(uint16_t cl) {
-    currentDirCluster = cl;
+// ------------------------------------------------------------
+// cwd path stack
+// ------------------------------------------------------------
+static const char dotdot83[11] = { '.', '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+
+static int path_push(uint16_t cl, const char *name83) {
+    // too deep for the stack: the path shows "..." from here on
+    if (vol->depth >= FAT16_MAX_DEPTH) {
+        vol->extra++;
+        vol->cwd = cl;
+        return 1;
+    }
+
+    vol->pathCluster[vol->depth] = cl;
+    fat16_decode_name(vol->pathName[vol->depth], name83);
+    vol->depth++;
+    vol->cwd = cl;
+    return 1;
+}
+
+static void path_pop() {
+    Fat16DirEntry e;
+
+    if (vol->extra > 1 && fat16_find_entry(vol->cwd, dotdot83, 0, 0, &e)) {
+        vol->extra--;
+        vol->cwd = e.cluster;
+        return;
+    }
+    if (vol->extra > 0)
+        vol->extra = 0;
+    else if (vol->depth > 0)
+        vol->depth--;
+    vol->cwd = vol->depth ? vol->pathCluster[vol->depth - 1] : 0;
+}
+
+// Rebuild the stack for an arbitrary directory by walking ".." links;
+// the ring keeps the FAT16_MAX_DEPTH levels nearest the root
+static void path_rebuild(uint16_t cl) {
+    uint16_t chain[FAT16_MAX_DEPTH];
+    uint16_t target = cl;
+    uint32_t n = 0;
+
+    while (cl != 0 && n <= vol->clusterCount) {
+        Fat16DirEntry e;
+        chain[n++ % FAT16_MAX_DEPTH] = cl;
+        if (!fat16_find_entry(cl, dotdot83, 0, 0, &e)) break;
+        cl = e.cluster;
+    }
+
+    uint32_t kept = n < FAT16_MAX_DEPTH ? n : FAT16_MAX_DEPTH;
+
+    vol->depth = 0;
+    vol->extra = n - kept;
+    vol->cwd = 0;
+
+    uint16_t parent = 0;
+    for (uint32_t i = n; i > n - kept; i--) {
+        uint16_t c = chain[(i - 1) % FAT16_MAX_DEPTH];
+
+        vol->pathCluster[vol->depth] = c;
+        if (!fat16_find_name_by_cluster(parent, c, vol->pathName[vol->depth]))
+            k_strcpy(vol->pathName[vol->depth], "?");
+        vol->depth++;
+        parent = c;
+    }
+    vol->cwd = vol->extra ? target : (vol->depth ? vol->pathCluster[vol->depth - 1] : 0);
+}
+
+void fat16_set_cwd(uint16_t cl) {
+    if (cl == 0) {
+        vol->depth = 0;
+        vol->extra = 0;
+        vol->cwd = 0;
+        return;
+    }
+    path_rebuild(cl);
 }
 
 // ------------------------------------------------------------
@@ -496,15 +1386,16 @@ int fat16_mkdir(const char *name) {
     fat16_format_83(name83, name);
 
     // check name conflict
-    if (fat16_find_in_directory(currentDirCluster, name) >= 0)
+    if (fat16_find_entry(vol->cwd, name83, 0, 0, 0))
         return 0;
 
     // allocate cluster
     uint16_t newCl = fat_alloc_cluster();
     if (newCl == 0) return 0;
+    dcache_forget_dir(newCl);
 
     // create "." and ".."
-    fat16_init_directory_cluster(newCl, currentDirCluster);
+    fat16_init_directory_cluster(newCl, vol->cwd);
 
     // build directory entry
     Fat16DirEntry e;
@@ -515,7 +1406,9 @@ int fat16_mkdir(const char *name) {
     e.size = 0;
 
     // write into current directory
-    return fat16_write_entry(currentDirCluster, &e);
+    int ok = fat16_write_entry(vol->cwd, &e);
+    fat_flush();
+    return ok;
 }
 
 // ------------------------------------------------------------
@@ -525,7 +1418,7 @@ int fat16_cd(const char *path) {
     // absolute -> go to root
     if (path[0] == '/') {
         // jump to root first
-        currentDirCluster = 0;
+        fat16_set_cwd(0);
 
         // skip leading '/'
         path++;
@@ -538,40 +1431,24 @@ int fat16_cd(const char *path) {
         return fat16_cd(path);
     }
 
-    // ".."
-    if (!k_strcmp(path, "..")) {
-        if (currentDirCluster == 0) return 1; // already root
-
-        // load current dir to get ".."
-        Fat16DirEntry entries[256];
-        int n = fat16_load_directory(currentDirCluster, entries, 256);
-
-        for (int i = 0; i < n; i++) {
-            if (entries[i].name[0] == 0x00) break;
-            if (entries[i].name[0] == 0xE5) continue;
+    Fat16DirEntry e;
+    char name83[11];
 
-            if (entries[i].attr == FAT16_ATTR_DIRECTORY &&
-                entries[i].name[0] == '.' &&
-                entries[i].name[1] == '.') {
-                currentDirCluster = entries[i].cluster;
-                return 1;
-            }
-        }
-        return 0;
+    // ".." comes off the path stack
+    if (!k_strcmp(path, "..")) {
+        path_pop();
+        return 1;
     }
 
     // normal subdirectory
-    int idx = fat16_find_in_directory(currentDirCluster, path);
-    if (idx < 0) return 0;
-
-    Fat16DirEntry entries[256];
-    fat16_load_directory(currentDirCluster, entries, 256);
+    fat16_format_83(name83, path);
+    if (!fat16_find_entry(vol->cwd, name83, 0, 0, &e))
+        return 0;
 
-    if (!(entries[idx].attr & FAT16_ATTR_DIRECTORY))
+    if (!(e.attr & FAT16_ATTR_DIRECTORY))
         return 0; // not a directory
 
-    currentDirCluster = entries[idx].cluster;
-    return 1;
+    return path_push(e.cluster, e.name);
 }
 
 // ------------------------------------------------------------
@@ -587,11 +1464,11 @@ int fat16_rename(const char *oldName, const char *newName) {
     Fat16DirEntry e;
 
     // find old entry
-    if (!fat16_find_entry(currentDirCluster, old83, &lba, &idx, &e))
+    if (!fat16_find_entry(vol->cwd, old83, &lba, &idx, &e))
         return 0;
 
     // name conflict
-    if (fat16_find_entry(currentDirCluster, new83, 0, 0, 0))
+    if (fat16_find_entry(vol->cwd, new83, 0, 0, 0))
         return 0;
 
     // immutable cannot rename
@@ -602,6 +1479,12 @@ int fat16_rename(const char *oldName, const char *newName) {
     k_memcpy(e.name, new83, 11);
     fat16_store_entry(lba, idx, &e);
 
+    // a renamed directory on the cwd path keeps its place with the new name
+    if (e.attr & FAT16_ATTR_DIRECTORY)
+        for (int i = 0; i < vol->depth; i++)
+            if (vol->pathCluster[i] == e.cluster)
+                fat16_decode_name(vol->pathName[i], e.name);
+
     return 1;
 }
 
@@ -659,95 +1542,168 @@ void fat16_decode_name(char out[13], const char name83[11]) {
 // ------------------------------------------------------------
 // Directory helpers
 // ------------------------------------------------------------
+static int fat16_scan_entry(uint16_t dirCluster, const char name83[11],
+                            uint32_t *outLBA, int *outIndex, Fat16DirEntry *outEntry) {
+    Fat16Dir d;
+    const Fat16DirEntry *e;
+
+    fat16_opendir(&d, dirCluster);
+    while ((e = dir_next(&d)) != 0) {
+        if (!k_memcmp(e->name, name83, 11)) {
+            if (outLBA) *outLBA = d.lba;
+            if (outIndex) *outIndex = d.slot - 1;
+            if (outEntry) *outEntry = *e;
+            fat16_closedir(&d);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Dentry cache: (volume, directory cluster, 8.3 name) -> where the
+// entry lives and a copy of it. Direct-mapped; a miss rescans the
+// directory and also caches "not found".
+// ------------------------------------------------------------
+static int dcache_hash(uint16_t dirCluster, const char name83[11]) {
+    uint32_t h = (uint32_t)(vol - volumes) * 65599 + dirCluster;
+
+    for (int i = 0; i < 11; i++)
+        h = h * 31 + (uint8_t)name83[i];
+    return h % FAT16_DCACHE_SIZE;
+}
+
 static int fat16_find_entry(uint16_t dirCluster, const char name83[11],
                             uint32_t *outLBA, int *outIndex, Fat16DirEntry *outEntry) {
-    Fat16DirEntry block[16];
+    Fat16Dentry *d = &dcache[dcache_hash(dirCluster, name83)];
 
-    if (dirCluster == 0) {
-        uint32_t rootEntries = bpb.rootEntryCount;
-        uint32_t sectors = ((rootEntries * 32) + 511) / 512;
+    if (d->vol == vol && d->dir == dirCluster && !k_memcmp(d->name, name83, 11)) {
+        dcacheHits++;
+    } else {
+        dcacheMisses++;
 
-        for (uint32_t i = 0; i < sectors; i++) {
-            uint32_t lba = rootDirStartLBA + i;
-            load_dir_sector(lba, block);
+        d->vol = vol;
+        d->dir = dirCluster;
+        k_memcpy(d->name, name83, 11);
+        d->found = fat16_scan_entry(dirCluster, name83, &d->lba, &d->index, &d->entry);
+    }
 
-            for (int j = 0; j < 16; j++) {
-                if (block[j].name[0] == 0x00) break;
-                if (block[j].name[0] == 0xE5) continue;
-                if (block[j].attr == FAT16_ATTR_LFN) continue;
-
-                if (!k_memcmp(block[j].name, name83, 11)) {
-                    if (outLBA) *outLBA = lba;
-                    if (outIndex) *outIndex = j;
-                    if (outEntry) *outEntry = block[j];
-                    return 1;
-                }
-            }
-        }
+    if (!d->found)
         return 0;
-    }
 
-    uint16_t cl = dirCluster;
-    while (cl >= 2) {
-        uint32_t lba = cluster_to_lba(cl);
+    if (outLBA) *outLBA = d->lba;
+    if (outIndex) *outIndex = d->index;
+    if (outEntry) {
+        *outEntry = d->entry;
 
-        for (uint8_t i = 0; i < bpb.sectorsPerCluster; i++) {
-            load_dir_sector(lba + i, block);
+        // size as written so far, buffered bytes included
+        Fat16Delay *dl = delay_find(d->lba, d->index);
+        if (dl) outEntry->size = dl->diskSize + dl->len;
+    }
+    return 1;
+}
 
-            for (int j = 0; j < 16; j++) {
-                if (block[j].name[0] == 0x00) break;
-                if (block[j].name[0] == 0xE5) continue;
-                if (block[j].attr == FAT16_ATTR_LFN) continue;
-
-                if (!k_memcmp(block[j].name, name83, 11)) {
-                    if (outLBA) *outLBA = lba + i;
-                    if (outIndex) *outIndex = j;
-                    if (outEntry) *outEntry = block[j];
-                    return 1;
-                }
-            }
-        }
-        cl = fat_next(cl);
+// A directory slot changed: drop lookups that hit that slot and any
+// (possibly negative) lookup of the name written into it
+static void dcache_forget(uint32_t lba, int index, const char name83[11]) {
+    for (int i = 0; i < FAT16_DCACHE_SIZE; i++) {
+        Fat16Dentry *d = &dcache[i];
+        if (d->vol != vol) continue;
+
+        if ((d->found && d->lba == lba && d->index == index) ||
+            !k_memcmp(d->name, name83, 11))
+            d->vol = 0;
     }
+}
 
-    return 0;
+// Directory cluster freed or reused: nothing cached under it is valid
+static void dcache_forget_dir(uint16_t dirCluster) {
+    for (int i = 0; i < FAT16_DCACHE_SIZE; i++)
+        if (dcache[i].vol == vol && dcache[i].dir == dirCluster)
+            dcache[i].vol = 0;
+}
+
+void fat16_dcache_stats(uint32_t *hits, uint32_t *misses) {
+    *hits = dcacheHits;
+    *misses = dcacheMisses;
 }
 
 static void fat16_store_entry(uint32_t lba, int index, const Fat16DirEntry *entry) {
     Fat16DirEntry block[16];
     load_dir_sector(lba, block);
     block[index] = *entry;
+
+    // while data is buffered the entry on disk keeps the size on disk
+    Fat16Delay *d = delay_find(lba, index);
+    uint32_t size = entry->size;
+    if (d) {
+        block[index].size = d->diskSize;
+        size = d->diskSize + d->len;
+    }
+
     save_dir_sector(lba, block);
+
+    dcache_forget(lba, index, entry->name);
+
+    // open handles on this entry follow it
+    for (int i = 0; i < FAT16_MAX_FILES; i++) {
+        Fat16File *f = &files[i];
+        if (f->vol != vol || f->dirLBA != lba || f->dirIndex != index) continue;
+
+        if (f->cur.first != entry->cluster) {
+            f->cur.first = entry->cluster;
+            f->cur.cl = entry->cluster;
+            f->cur.base = 0;
+            map_reset(&f->map);
+        } else if (size < f->size) {
+            uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+            map_truncate(&f->map, (size + clusterSize - 1) / clusterSize);
+            f->cur.cl = 0;
+        }
+        f->size = size;
+    }
+}
+
+static int file_is_open(uint32_t lba, int index) {
+    for (int i = 0; i < FAT16_MAX_FILES; i++)
+        if (files[i].vol == vol && files[i].dirLBA == lba && files[i].dirIndex == index)
+            return 1;
+    return 0;
 }
 
 static void fat16_free_chain(uint16_t cl) {
+    // handles on this chain lose their cursor and extents
+    for (int i = 0; i < FAT16_MAX_FILES; i++) {
+        Fat16File *f = &files[i];
+        if (f->vol != vol || f->cur.first != cl) continue;
+
+        f->cur.cl = 0;
+        map_reset(&f->map);
+    }
+
     while (cl >= 2) {
         uint16_t next = fat_next(cl);
         fat_set(cl, FAT16_FREE);
         if (next == 0) break;
         cl = next;
     }
-    fat_flush();
 }
 
 int fat16_list_dir(uint16_t dirCluster, char names[][13], int max) {
     for (int i = 0; i < max; i++)
         names[i][0] = '\0';
 
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(dirCluster, entries, 256);
-
+    Fat16Dir d;
+    const Fat16DirEntry *e;
     int count = 0;
-    for (int i = 0; i < n && count < max; i++) {
-        Fat16DirEntry *e = &entries[i];
-
-        if (e->name[0] == 0x00) break;
-        if (e->name[0] == 0xE5) continue;
-        if (e->attr == FAT16_ATTR_LFN) continue;
 
+    fat16_opendir(&d, dirCluster);
+    while (count < max && (e = dir_next(&d)) != 0) {
         fat16_decode_name(names[count], e->name);
         count++;
     }
+    fat16_closedir(&d);
     return count;
 }
 
@@ -773,7 +1729,7 @@ int fat16_create_file(const char *filename) {
 
     uint32_t lba;
     int idx;
-    if (fat16_find_entry(currentDirCluster, name83, &lba, &idx, 0))
+    if (fat16_find_entry(vol->cwd, name83, &lba, &idx, 0))
         return 0; // already exists
 
     Fat16DirEntry e;
@@ -784,7 +1740,7 @@ int fat16_create_file(const char *filename) {
     e.size = 0;
     e.flags = PERM_R | PERM_W;
 
-    return fat16_write_entry(currentDirCluster, &e);
+    return fat16_write_entry(vol->cwd, &e);
 }
 
 int fat16_delete(const char *filename) {
@@ -794,114 +1750,432 @@ int fat16_delete(const char *filename) {
     uint32_t lba;
     int idx;
     Fat16DirEntry e;
-    if (!fat16_find_entry(currentDirCluster, name83, &lba, &idx, &e))
+    if (!fat16_find_entry(vol->cwd, name83, &lba, &idx, &e))
         return 0;
 
-    if (!fat16_can_delete(&e)) {
+    if (!fat16_can_delete(&e) || file_is_open(lba, idx)) {
         return 0;
     }
 
+    // buffered data never reaches the disk
+    Fat16Delay *d = delay_find(lba, idx);
+    if (d) d->vol = 0;
+
     if (e.cluster >= 2) {
         fat16_free_chain(e.cluster);
+        if (e.attr & FAT16_ATTR_DIRECTORY)
+            dcache_forget_dir(e.cluster);
     }
 
     e.name[0] = 0xE5;   // mark deleted
     e.size = 0;
     e.cluster = 0;
     fat16_store_entry(lba, idx, &e);
+    fat_flush();
 
     return 1;
 }
 
 static int fat16_allocate_chain(int clustersNeeded, uint16_t *firstOut) {
-    uint16_t first = 0;
-    uint16_t prev = 0;
+    uint16_t first = fat_alloc_runs(clustersNeeded, 0);
+    if (!first) return 0;
 
-    for (int i = 0; i < clustersNeeded; i++) {
-        uint16_t cl = fat_alloc_cluster();
-        if (!cl) {
-            if (first) fat16_free_chain(first);
-            return 0;
-        }
+    *firstOut = first;
+    return 1;
+}
 
-        if (!first) first = cl;
-        if (prev) {
-            fat_set(prev, cl);
+// ------------------------------------------------------------
+// Cluster-run reads kept in flight by fat16_read_chain. Each one
+// remembers where its first sector sits in the file's clusters so
+// the sectors can enter the page cache once the read completes.
+// ------------------------------------------------------------
+typedef struct {
+    BlockRequest req;
+    uint16_t     cl;
+    uint8_t      index;         // sector within cl
+} Fat16Read;
+
+typedef struct {
+    Fat16Read reads[FAT16_READ_INFLIGHT];
+    int head;
+    int inflight;
+} Fat16ReadRing;
+
+static void read_ring_retire(Fat16ReadRing *ring) {
+    Fat16Read *rd = &ring->reads[ring->head];
+
+    ring->head = (ring->head + 1) % FAT16_READ_INFLIGHT;
+    ring->inflight--;
+
+    if (!blockdev_wait(&rd->req))
+        return;
+
+    // the request went past the buffer cache and the write queue
+    bcache_overlay(rd->req.dev, rd->req.lba, rd->req.count, rd->req.buf);
+
+    uint16_t cl = rd->cl;
+    uint8_t index = rd->index;
+    const uint8_t *src = (const uint8_t *)rd->req.buf;
+
+    for (uint32_t i = 0; i < rd->req.count; i++, src += FAT16_SECTOR_SIZE) {
+        pcache_insert(vol, cl, index, src);
+        if (++index == vol->bpb.sectorsPerCluster) {
+            index = 0;
+            cl++;
         }
-        prev = cl;
     }
+}
 
-    if (prev) fat_set(prev, FAT16_EOC);
-    fat_flush();
+static void read_ring_submit(Fat16ReadRing *ring, uint16_t cl, uint8_t index,
+                             uint32_t lba, uint32_t count, void *buf) {
+    if (ring->inflight == FAT16_READ_INFLIGHT)
+        read_ring_retire(ring);
+
+    Fat16Read *rd = &ring->reads[(ring->head + ring->inflight) % FAT16_READ_INFLIGHT];
+    k_memset(rd, 0, sizeof(*rd));
+    rd->cl          = cl;
+    rd->index       = index;
+    rd->req.dev     = vol->dev;
+    rd->req.lba     = vol->partStart + lba;
+    rd->req.count   = count;
+    rd->req.buf     = buf;
+    if (blockdev_submit(&rd->req))
+        ring->inflight++;
+}
 
-    *firstOut = first;
-    return 1;
+// ------------------------------------------------------------
+// Boot prefetch log. Demand reads on the boot volume are noted until
+// FAT16_BOOTLOG_COMMANDS commands or FAT16_BOOTLOG_SECONDS have passed;
+// the sorted list is then saved to FAT16_BOOTLOG_NAME in the root.
+// At the next boot those clusters are read in one sweep in LBA order.
+// ------------------------------------------------------------
+static void bootlog_note(uint16_t cl, uint32_t count) {
+    if (!bootLogActive || vol != bootVol) return;
+    if (irq_ticks() - bootLogStart >= FAT16_BOOTLOG_SECONDS * IRQ_TIMER_HZ) return;
+
+    for (; count; count--, cl++) {
+        if (bootLog.count == FAT16_BOOTLOG_MAX) return;
+        if (bootLog.count && bootLog.cluster[bootLog.count - 1] == cl) continue;
+        bootLog.cluster[bootLog.count++] = cl;
+    }
 }
 
-int fat16_write_file(const char *filename, const void *data, uint32_t size) {
+static void bootlog_save() {
+    // sort, dropping duplicates
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < bootLog.count; i++) {
+        uint16_t c = bootLog.cluster[i];
+        uint32_t j = n;
+
+        while (j && bootLog.cluster[j - 1] > c) j--;
+        if (j && bootLog.cluster[j - 1] == c) continue;
+
+        for (uint32_t k = n; k > j; k--)
+            bootLog.cluster[k] = bootLog.cluster[k - 1];
+        bootLog.cluster[j] = c;
+        n++;
+    }
+    bootLog.count = n;
+
+    if (n == bootLogPrevCount &&
+        !k_memcmp(bootLog.cluster, bootLogPrev, n * sizeof(uint16_t)))
+        return;
+
+    // the log lives in the root of the boot volume, hidden; it can be
+    // deleted like any other file
+    Fat16Volume *cur = vol;
+    vol = bootVol;
+    uint16_t cwd = vol->cwd;
+    vol->cwd = 0;
+
     char name83[11];
-    fat16_format_83(name83, filename);
+    fat16_format_83(name83, FAT16_BOOTLOG_NAME);
 
     uint32_t lba;
     int idx;
     Fat16DirEntry e;
-    if (!fat16_find_entry(currentDirCluster, name83, &lba, &idx, &e))
-        return 0;
+    if (fat16_create_file(FAT16_BOOTLOG_NAME) &&
+        fat16_find_entry(0, name83, &lba, &idx, &e)) {
+        e.attr |= FAT16_ATTR_HIDDEN;
+        e.flags |= PERM_H;
+        fat16_store_entry(lba, idx, &e);
+    }
 
-    if (!fat16_can_write(&e)) {
-        return 0;
+    fat16_write_file(FAT16_BOOTLOG_NAME, &bootLog, 8 + n * sizeof(uint16_t));
+    fat16_sync();
+
+    vol->cwd = cwd;
+    vol = cur;
+}
+
+void fat16_bootlog_tick() {
+    if (!bootLogActive) return;
+
+    if (++bootLogCommands < FAT16_BOOTLOG_COMMANDS &&
+        irq_ticks() - bootLogStart < FAT16_BOOTLOG_SECONDS * IRQ_TIMER_HZ)
+        return;
+
+    bootLogActive = 0;
+    bootlog_save();
+}
+
+static void bootlog_prefetch() {
+    char name83[11];
+    fat16_format_83(name83, FAT16_BOOTLOG_NAME);
+
+    uint32_t lba;
+    int idx;
+    Fat16DirEntry e;
+    if (!fat16_find_entry(0, name83, &lba, &idx, &e))
+        return;
+    if (e.size < 8 || e.size > sizeof(bootLog))
+        return;
+
+    Fat16Cursor cur;
+    cursor_init(&cur, e.cluster);
+    fat16_read_chain(&cur, 0, &bootLog, e.size, e.size);
+    if (bootLog.magic != FAT16_BOOTLOG_MAGIC || 8 + bootLog.count * sizeof(uint16_t) != e.size)
+        return;
+
+    k_memcpy(bootLogPrev, bootLog.cluster, bootLog.count * sizeof(uint16_t));
+    bootLogPrevCount = bootLog.count;
+
+    uint32_t spc = vol->bpb.sectorsPerCluster;
+    if (spc > FAT16_RA_MAX)
+        return;
+
+    Fat16ReadRing ring;
+    ring.head = 0;
+    ring.inflight = 0;
+    uint32_t used = 0;                  // sectors of raBuf in flight
+    uint32_t loaded = 0;
+
+    for (uint32_t i = 0; i < bootLog.count; ) {
+        uint16_t cl = bootLog.cluster[i];
+        uint32_t n = 1;
+
+        if (cl < 2 || cl >= vol->clusterCount + 2 || pcache_contains(vol, cl, 0)) {
+            i++;
+            continue;
+        }
+
+        // adjacent clusters go out as one read, up to the size of raBuf
+        while (i + n < bootLog.count && bootLog.cluster[i + n] == cl + n &&
+               cl + n < vol->clusterCount + 2 && (n + 1) * spc <= FAT16_RA_MAX)
+            n++;
+
+        if (used + n * spc > FAT16_RA_MAX) {
+            while (ring.inflight)
+                read_ring_retire(&ring);
+            used = 0;
+        }
+
+        read_ring_submit(&ring, cl, 0, cluster_to_lba(cl), n * spc,
+                         raBuf + used * FAT16_SECTOR_SIZE);
+        used += n * spc;
+        loaded += n;
+        i += n;
     }
 
-    if (e.cluster >= 2) {
-        fat16_free_chain(e.cluster);
-        e.cluster = 0;
+    while (ring.inflight)
+        read_ring_retire(&ring);
+
+    if (loaded)
+        terminal_printf("Prefetched %u clusters.\n", loaded);
+}
+
+// ------------------------------------------------------------
+// Readahead. A read that starts at 0, or continues where the last
+// read of the same file ended (or inside what was read ahead for
+// it), is sequential; each sequential read doubles the window.
+// ------------------------------------------------------------
+static Fat16Stream *ra_stream(uint16_t first, uint32_t offset, uint32_t end) {
+    Fat16Stream *s = 0;
+    Fat16Stream *victim = &streams[0];
+
+    for (int i = 0; i < FAT16_RA_STREAMS; i++) {
+        if (streams[i].vol == vol && streams[i].cluster == first) {
+            s = &streams[i];
+            break;
+        }
+        if (streams[i].lastUse < victim->lastUse)
+            victim = &streams[i];
     }
 
-    uint32_t clusterSize = FAT16_SECTOR_SIZE * bpb.sectorsPerCluster;
-    int clustersNeeded = (size + clusterSize - 1) / clusterSize;
+    if (!s) {
+        s = victim;
+        s->vol = vol;
+        s->cluster = first;
+        s->window = offset == 0 ? FAT16_RA_MIN : 0;
+        s->raEnd = 0;
+    } else if (offset >= s->next && (offset <= s->raEnd || offset == s->next)) {
+        s->window = s->window ? s->window * 2 : FAT16_RA_MIN;
+        if (s->window > FAT16_RA_MAX) s->window = FAT16_RA_MAX;
+    } else {
+        s->window = 0;
+    }
 
-    if (clustersNeeded == 0) {
-        e.size = 0;
-        fat16_store_entry(lba, idx, &e);
-        return 1;
+    s->next = end;
+    s->lastUse = ++raClock;
+    return s;
+}
+
+// Queue reads for `count` sectors from sector `index` of `cl` on that
+// are not cached yet; they land in raBuf and enter the page cache as
+// the ring retires them
+static void read_ahead(Fat16ReadRing *ring, uint16_t cl, uint32_t index, uint32_t count) {
+    uint32_t spc = vol->bpb.sectorsPerCluster;
+    uint32_t used = 0;
+
+    while (count && cl >= 2) {
+        uint32_t run = fat_contiguous_run(cl, (index + count + spc - 1) / spc);
+        uint32_t runLBA = cluster_to_lba(cl);
+
+        uint32_t end = run * spc;
+        if (end > index + count) end = index + count;
+
+        // one pass past the end flushes the last stretch of misses
+        uint32_t missSec = 0, missCount = 0;
+        for (uint32_t sec = index; sec <= end; sec++) {
+            if (sec < end && !pcache_contains(vol, cl + sec / spc, sec % spc)) {
+                if (!missCount) missSec = sec;
+                missCount++;
+                continue;
+            }
+
+            if (missCount) {
+                read_ring_submit(ring, cl + missSec / spc, missSec % spc, runLBA + missSec,
+                                 missCount, raBuf + used * FAT16_SECTOR_SIZE);
+                used += missCount;
+                missCount = 0;
+            }
+        }
+
+        count -= end - index;
+        index = 0;
+        cl = fat_next(cl + run - 1);
     }
+}
 
-    uint16_t firstCl;
-    if (!fat16_allocate_chain(clustersNeeded, &firstCl))
-        return 0;
+// ------------------------------------------------------------
+// Read `size` bytes at `offset` of the chain under `cur`, a file of
+// `fileSize` bytes; the cursor is left on the last cluster read. Sectors already in the page cache are
+// copied from it; the rest go straight into the caller's buffer,
+// one ranged read per stretch of missing sectors, several reads in
+// flight at once. Sequential readers also get the next window of
+// the file pulled into the page cache alongside.
+// ------------------------------------------------------------
+static uint32_t fat16_read_chain(Fat16Cursor *cur, uint32_t offset, void *buffer,
+                                 uint32_t size, uint32_t fileSize) {
+    uint8_t *dst = (uint8_t *)buffer;
+    uint32_t spc = vol->bpb.sectorsPerCluster;
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * spc;
+    uint32_t readBytes = 0;
 
-    e.cluster = firstCl;
-    e.size = size;
+    Fat16Stream *stream = ra_stream(cur->first, offset, offset + size);
 
-    // write data to clusters sector-by-sector
-    uint16_t cl = firstCl;
-    uint32_t written = 0;
-    uint8_t buf[FAT16_SECTOR_SIZE];
+    // the cursor skips the clusters before offset
+    uint16_t cl = cursor_seek(cur, offset);
+    uint32_t clusterOffset = offset - cur->base;
 
-    while (cl && written < size) {
-        uint32_t lba = cluster_to_lba(cl);
+    // where the read stops: readahead picks up from here
+    uint16_t raCl = 0;
+    uint32_t raIndex = 0;
 
-        for (uint8_t s = 0; s < bpb.sectorsPerCluster && written < size; s++) {
-            uint32_t remaining = size - written;
-            uint32_t toWrite = remaining < FAT16_SECTOR_SIZE ? remaining : FAT16_SECTOR_SIZE;
+    uint8_t temp[FAT16_SECTOR_SIZE];
+    Fat16ReadRing ring;
+    ring.head = 0;
+    ring.inflight = 0;
 
-            if (toWrite < FAT16_SECTOR_SIZE) {
-                k_memset(buf, 0, FAT16_SECTOR_SIZE);
-                k_memcpy(buf, ((const uint8_t *)data) + written, toWrite);
-                write_sector(lba + s, buf);
+    while (readBytes < size && cl >= 2) {
+        uint32_t remain = size - readBytes;
+        uint32_t want = (clusterOffset + remain + clusterSize - 1) / clusterSize;
+        uint32_t run = fat_contiguous_run(cl, want);
+        uint32_t runLBA = cluster_to_lba(cl);
+
+        uint32_t sec = clusterOffset / FAT16_SECTOR_SIZE;     // sector within the run
+        uint32_t secOffset = clusterOffset % FAT16_SECTOR_SIZE;
+        uint32_t firstSec = sec;
+        uint32_t runBase = offset + readBytes - clusterOffset;
+
+        uint32_t bytes = run * clusterSize - clusterOffset;
+        if (bytes > remain) bytes = remain;
+
+        // stretch of whole sectors missing from the page cache
+        uint32_t missSec = 0, missCount = 0;
+        uint8_t *missDst = 0;
+
+        while (bytes) {
+            uint16_t pcl = cl + sec / spc;
+            uint8_t pidx = sec % spc;
+            uint32_t n = FAT16_SECTOR_SIZE - secOffset;
+            if (n > bytes) n = bytes;
+
+            if (n == FAT16_SECTOR_SIZE && !pcache_lookup(vol, pcl, pidx, dst + readBytes)) {
+                if (!missCount) {
+                    missSec = sec;
+                    missDst = dst + readBytes;
+                }
+                missCount++;
             } else {
-                write_sector(lba + s, ((const uint8_t *)data) + written);
+                if (missCount) {
+                    read_ring_submit(&ring, cl + missSec / spc, missSec % spc,
+                                     runLBA + missSec, missCount, missDst);
+                    missCount = 0;
+                }
+
+                // partial sector: through the page cache into a temp buffer
+                if (n < FAT16_SECTOR_SIZE) {
+                    if (!pcache_lookup(vol, pcl, pidx, temp)) {
+                        read_sector(runLBA + sec, temp);
+                        pcache_insert(vol, pcl, pidx, temp);
+                    }
+                    k_memcpy(dst + readBytes, temp + secOffset, n);
+                }
             }
 
-            written += toWrite;
+            readBytes += n;
+            bytes -= n;
+            secOffset = 0;
+            sec++;
         }
 
-        cl = fat_next(cl);
-        if (cl == 0) break;
+        if (missCount)
+            read_ring_submit(&ring, cl + missSec / spc, missSec % spc,
+                             runLBA + missSec, missCount, missDst);
+
+        bootlog_note(cl + firstSec / spc, (sec - 1) / spc - firstSec / spc + 1);
+        cur->cl = cl + (sec - 1) / spc;
+        cur->base = runBase + (sec - 1) / spc * clusterSize;
+
+        clusterOffset = 0;
+        if (sec < run * spc) {          // stopped inside this run
+            raCl = cl + sec / spc;
+            raIndex = sec % spc;
+            break;
+        }
+
+        cl = fat_next(cl + run - 1);
+        raCl = cl;
+        raIndex = 0;
     }
 
-    fat16_store_entry(lba, idx, &e);
-    return 1;
+    // next window of the file, while the demand reads are in flight
+    uint32_t raStart = (offset + readBytes + FAT16_SECTOR_SIZE - 1) / FAT16_SECTOR_SIZE;
+    uint32_t fileSectors = (fileSize + FAT16_SECTOR_SIZE - 1) / FAT16_SECTOR_SIZE;
+    uint32_t ra = stream->window;
+
+    if (readBytes == size && raCl >= 2 && raStart < fileSectors) {
+        if (ra > fileSectors - raStart) ra = fileSectors - raStart;
+        read_ahead(&ring, raCl, raIndex, ra);
+        if ((raStart + ra) * FAT16_SECTOR_SIZE > stream->raEnd)
+            stream->raEnd = (raStart + ra) * FAT16_SECTOR_SIZE;
+    }
+
+    while (ring.inflight)
+        read_ring_retire(&ring);
+
+    return readBytes;
 }
 
 uint32_t fat16_read_file(const char *filename, void *buffer, uint32_t maxSize) {
@@ -911,34 +2185,20 @@ uint32_t fat16_read_file(const char *filename, void *buffer, uint32_t maxSize) {
     uint32_t lba;
     int idx;
     Fat16DirEntry e;
-    if (!fat16_find_entry(currentDirCluster, name83, &lba, &idx, &e))
+    if (!fat16_find_entry(vol->cwd, name83, &lba, &idx, &e))
         return 0;
 
+    // the buffered tail has to be on disk to be read
+    int flushed = delay_flush_slot(lba, idx);
+    if (flushed < 0) return 0;
+    if (flushed) fat16_get_entry(lba, idx, &e);
+
     uint32_t size = e.size;
     if (size > maxSize) size = maxSize;
 
-    uint32_t readBytes = 0;
-    uint16_t cl = e.cluster;
-
-    while (cl && readBytes < size) {
-        uint32_t lba = cluster_to_lba(cl);
-
-        for (uint8_t s = 0; s < bpb.sectorsPerCluster && readBytes < size; s++) {
-            uint8_t buf[FAT16_SECTOR_SIZE];
-            read_sector(lba + s, buf);
-
-            uint32_t remaining = size - readBytes;
-            uint32_t toCopy = remaining < FAT16_SECTOR_SIZE ? remaining : FAT16_SECTOR_SIZE;
-            k_memcpy(((uint8_t *)buffer) + readBytes, buf, toCopy);
-
-            readBytes += toCopy;
-        }
-
-        cl = fat_next(cl);
-        if (cl == 0) break;
-    }
-
-    return readBytes;
+    Fat16Cursor cur;
+    cursor_init(&cur, e.cluster);
+    return fat16_read_chain(&cur, 0, buffer, size, e.size);
 }
 
 // ------------------------------------------------------------
@@ -953,138 +2213,582 @@ int fat16_delete_file(const char *name) {
 }
 
 int fat16_find_name_by_cluster(uint16_t parentCl, uint16_t targetCl, char out[13]) {
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(parentCl, entries, 256);
-
-    for (int i = 0; i < n; i++) {
-        Fat16DirEntry *e = &entries[i];
-        if (e->name[0] == 0x00) break;
-        if (e->name[0] == 0xE5) continue;
-        if (e->attr == FAT16_ATTR_LFN) continue;
+    Fat16Dir d;
+    const Fat16DirEntry *e;
 
+    fat16_opendir(&d, parentCl);
+    while ((e = dir_next(&d)) != 0) {
         if (e->cluster == targetCl) {
             fat16_decode_name(out, e->name);
+            fat16_closedir(&d);
             return 1;
         }
     }
     return 0;
 }
 
+// Path of the cwd, from the path stack (no disk access). Levels past
+// FAT16_MAX_DEPTH show as a single "/..."
 void fat16_get_path(char *out) {
-    char parts[16][13];
-    int depth = 0;
+    int pos = 0;
+    out[pos++] = '/';
 
-    uint16_t cur = fat16_get_cwd();
+    for (int i = 0; i < vol->depth; i++) {
+        const char *p = vol->pathName[i];
+        while (*p) out[pos++] = *p++;
+        if (i + 1 < vol->depth) out[pos++] = '/';
+    }
 
-    // root
-    if (cur == 0) {
-        out[0] = '/';
-        out[1] = 0;
-        return;
+    if (vol->extra) {
+        const char *p = "/...";
+        while (*p) out[pos++] = *p++;
     }
 
-    while (cur != 0) {
+    out[pos] = 0;
+}
 
-        // load ".."
-        Fat16DirEntry entries[256];
-        int n = fat16_load_directory(cur, entries, 256);
+uint32_t fat16_read_partial(const char *filename, void *buffer, uint32_t size, uint32_t offset) {
+    char name83[11];
+    fat16_format_83(name83, filename);
+
+    uint32_t lba;
+    int idx;
+    Fat16DirEntry e;
+    if (!fat16_find_entry(vol->cwd, name83, &lba, &idx, &e))
+        return 0;
+
+    // the buffered tail has to be on disk to be read
+    int flushed = delay_flush_slot(lba, idx);
+    if (flushed < 0) return 0;
+    if (flushed) fat16_get_entry(lba, idx, &e);
+
+    uint32_t filesize = e.size;
+    if (offset >= filesize) return 0;
+
+    if (offset + size > filesize)
+        size = filesize - offset;
+
+    Fat16Cursor cur;
+    cursor_init(&cur, e.cluster);
+    return fat16_read_chain(&cur, offset, buffer, size, filesize);
+}
+
+// ============================================================
+// File handles
+// ============================================================
+static Fat16File *file_get(int fd) {
+    if (fd < 0 || fd >= FAT16_MAX_FILES || !files[fd].vol)
+        return 0;
+    return &files[fd];
+}
+
+// Handle state for the entry in directory slot (lba, idx)
+static void file_from_entry(Fat16File *f, uint32_t lba, int idx, const Fat16DirEntry *e, int mode) {
+    f->vol = vol;
+    f->dirLBA = lba;
+    f->dirIndex = idx;
+    f->mode = mode;
+    f->size = e->size;
+    f->pos = 0;
+    cursor_init(&f->cur, e->cluster);
+}
+
+int fat16_open(const char *filename, int mode) {
+    char name83[11];
+    fat16_format_83(name83, filename);
+
+    uint32_t lba;
+    int idx;
+    Fat16DirEntry e;
+    if (!fat16_find_entry(vol->cwd, name83, &lba, &idx, &e)) {
+        if (!(mode & FAT16_O_CREATE) || !fat16_create_file(filename) ||
+            !fat16_find_entry(vol->cwd, name83, &lba, &idx, &e))
+            return -1;
+    }
 
-        uint16_t parent = 0;
+    if (e.attr & FAT16_ATTR_DIRECTORY) return -1;
+    if ((mode & FAT16_O_WRITE) && !fat16_can_write(&e)) return -1;
 
-        for (int i = 0; i < n; i++) {
-            if (entries[i].name[0] == 0x00) break;
+    int fd = 0;
+    while (fd < FAT16_MAX_FILES && files[fd].vol) fd++;
+    if (fd == FAT16_MAX_FILES) return -1;
 
-            // find ".."
-            if (entries[i].name[0] == '.' &&
-                entries[i].name[1] == '.') {
-                parent = entries[i].cluster;
+    Fat16File *f = &files[fd];
+    file_from_entry(f, lba, idx, &e, mode);
+    f->cur.map = &f->map;
+    map_reset(&f->map);
+
+    if ((mode & FAT16_O_WRITE) && (mode & FAT16_O_TRUNC) && (e.cluster || e.size)) {
+        Fat16Delay *d = delay_find(lba, idx);
+        if (d) d->vol = 0;
+
+        fat16_free_chain(e.cluster);
+        e.cluster = 0;
+        e.size = 0;
+        fat16_store_entry(lba, idx, &e);
+        fat_flush();
+    }
+
+    return fd;
+}
+
+int fat16_close(int fd) {
+    Fat16File *f = file_get(fd);
+    if (!f) return 0;
+
+    int ok = 1;
+
+    if (f->mode & FAT16_O_WRITE) {
+        Fat16Volume *cur = vol;
+        vol = f->vol;
+        if (delay_flush_slot(f->dirLBA, f->dirIndex) < 0)
+            ok = 0;         // data still buffered; fat16_sync retries it
+        vol = cur;
+    }
+
+    f->vol = 0;
+    return ok;
+}
+
+int fat16_read(int fd, void *buffer, uint32_t size) {
+    Fat16File *f = file_get(fd);
+    if (!f || !(f->mode & FAT16_O_READ)) return -1;
+
+    if (f->pos >= f->size) return 0;
+    if (size > f->size - f->pos) size = f->size - f->pos;
+
+    Fat16Volume *cur = vol;
+    vol = f->vol;
+    if (delay_flush_slot(f->dirLBA, f->dirIndex) < 0) {
+        vol = cur;
+        return -1;
+    }
+    uint32_t n = fat16_read_chain(&f->cur, f->pos, buffer, size, f->size);
+    vol = cur;
+
+    f->pos += n;
+    return n;
+}
+
+// Make the chain at least `clusters` long; 0 (chain unchanged) if the
+// disk has too little free space. New clusters continue the last run
+// when the space after it is free.
+static int file_grow(Fat16File *f, uint32_t clusters) {
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+
+    if (!f->cur.first) {
+        uint16_t first;
+        if (!fat16_allocate_chain(clusters, &first)) return 0;
+
+        f->cur.first = first;
+        f->cur.cl = first;
+        f->cur.base = 0;
+        return 1;
+    }
+
+    // long enough already, or the cursor is left on the last cluster
+    if (cursor_seek(&f->cur, clusters * clusterSize - 1))
+        return 1;
+
+    uint32_t need = clusters - (f->cur.base / clusterSize + 1);
+    uint16_t cl = fat_alloc_runs(need, f->cur.cl);
+    if (!cl) return 0;
+
+    if (f->cur.map && f->cur.map->built)
+        for (uint16_t c = cl; c >= 2; c = fat_next(c))
+            map_append(f->cur.map, c);
+    return 1;
+}
+
+// Write at f->pos (at most f->size), one contiguous cluster run at a
+// time. Only the clusters the range touches are written; the chain is
+// extended first if the file grows.
+static uint32_t file_write(Fat16File *f, const uint8_t *src, uint32_t size) {
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+    uint16_t first = f->cur.first;
+    uint32_t written = 0;
+    uint8_t buf[FAT16_SECTOR_SIZE];
+
+    if (!size) return 0;
+
+    // disk full: write what the chain has room for
+    if (!file_grow(f, (f->pos + size + clusterSize - 1) / clusterSize)) {
+        uint32_t room = f->cur.first ? f->cur.base + clusterSize : 0;
+        size = room > f->pos ? room - f->pos : 0;
+    }
+
+    while (written < size) {
+        uint16_t cl = cursor_seek(&f->cur, f->pos);
+        uint32_t inCluster = f->pos - f->cur.base;
+        uint32_t left = size - written;
+
+        uint32_t run = fat_contiguous_run(cl, (inCluster + left + clusterSize - 1) / clusterSize);
+        uint32_t lba = cluster_to_lba(cl) + inCluster / FAT16_SECTOR_SIZE;
+        uint32_t secOffset = inCluster % FAT16_SECTOR_SIZE;
+
+        uint32_t n = run * clusterSize - inCluster;
+        if (n > left) n = left;
+
+        f->pos += n;
+        f->cur.cl = cl + run - 1;
+        f->cur.base += (run - 1) * clusterSize;
+
+        // sectors only partly covered keep the rest of their bytes
+        while (n) {
+            uint32_t part = FAT16_SECTOR_SIZE - secOffset;
+            if (part > n) part = n;
+
+            if (part == FAT16_SECTOR_SIZE) {
+                uint32_t full = n / FAT16_SECTOR_SIZE;
+                write_sectors(lba, full, src + written);
+                part = full * FAT16_SECTOR_SIZE;
+                lba += full;
+            } else {
+                read_sector(lba, buf);
+                k_memcpy(buf + secOffset, src + written, part);
+                write_sector(lba++, buf);
+            }
+
+            written += part;
+            n -= part;
+            secOffset = 0;
+        }
+    }
+
+    if (f->pos > f->size || f->cur.first != first) {
+        if (f->pos > f->size) f->size = f->pos;
+
+        Fat16DirEntry e;
+        fat16_get_entry(f->dirLBA, f->dirIndex, &e);
+        e.cluster = f->cur.first;
+        e.size = f->size;
+        fat16_store_entry(f->dirLBA, f->dirIndex, &e);
+    }
+
+    return written;
+}
+
+// Cut the file to `size` bytes, freeing only the clusters past it
+static void file_truncate(Fat16File *f, uint32_t size) {
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+    uint32_t keep = (size + clusterSize - 1) / clusterSize;
+
+    Fat16Delay *d = delay_find(f->dirLBA, f->dirIndex);
+    if (d) {
+        // the new end is inside the buffer: no disk I/O at all
+        if (size >= d->diskSize) {
+            d->len = size - d->diskSize;
+            if (!d->len) d->vol = 0;
+
+            f->size = size;
+            if (f->pos > size) f->pos = size;
+            delay_set_size(f->dirLBA, f->dirIndex, size);
+            return;
+        }
+        d->vol = 0;
+    }
+
+    if (keep == 0) {
+        fat16_free_chain(f->cur.first);
+        f->cur.first = 0;
+        f->cur.cl = 0;
+    } else {
+        uint16_t last = cursor_seek(&f->cur, (keep - 1) * clusterSize);
+        uint16_t next = last ? fat_next(last) : 0;
+
+        if (next) {
+            fat_set(last, FAT16_EOC);
+            fat16_free_chain(next);
+        }
+    }
+
+    if (f->cur.map)
+        map_truncate(f->cur.map, keep);
+
+    f->size = size;
+    if (f->pos > size) f->pos = size;
+
+    Fat16DirEntry e;
+    fat16_get_entry(f->dirLBA, f->dirIndex, &e);
+    e.cluster = f->cur.first;
+    e.size = size;
+    fat16_store_entry(f->dirLBA, f->dirIndex, &e);
+}
+
+// ------------------------------------------------------------
+// Delayed allocation
+// ------------------------------------------------------------
+static inline uint8_t *delay_data(Fat16Delay *d) {
+    return (uint8_t *)FAT16_DELAY_BASE + (d - delays) * FAT16_DELAY_BYTES;
+}
+
+static Fat16Delay *delay_find(uint32_t lba, int index) {
+    for (int i = 0; i < FAT16_DELAY_FILES; i++)
+        if (delays[i].vol == vol && delays[i].dirLBA == lba && delays[i].dirIndex == index)
+            return &delays[i];
+    return 0;
+}
+
+// Write the buffer out; the clusters are allocated now, in one go,
+// for the file's final length. 0 if the volume ran out of space: the
+// bytes that did not fit stay buffered for a later flush.
+static int delay_flush(Fat16Delay *d) {
+    Fat16Volume *cur = vol;
+    vol = d->vol;
+
+    // dropped first, so the entry update below stores the real size
+    d->vol = 0;
+
+    Fat16DirEntry e;
+    Fat16File f;
+    fat16_get_entry(d->dirLBA, d->dirIndex, &e);
+    file_from_entry(&f, d->dirLBA, d->dirIndex, &e, FAT16_O_WRITE);
+    f.pos = d->diskSize;
+
+    uint32_t n = file_write(&f, delay_data(d), d->len);
+    fat_flush();
+
+    int ok = n == d->len;
+    if (!ok) {
+        uint8_t *data = delay_data(d);
+        for (uint32_t i = n; i < d->len; i++)
+            data[i - n] = data[i];
+
+        d->vol = vol;
+        d->diskSize += n;
+        d->len -= n;
+    }
+
+    vol = cur;
+    return ok;
+}
+
+// 1 if the file had a buffer and it was written out, 0 if it had none,
+// -1 if it could not be written out
+static int delay_flush_slot(uint32_t lba, int index) {
+    Fat16Delay *d = delay_find(lba, index);
+    if (!d) return 0;
+
+    return delay_flush(d) ? 1 : -1;
+}
+
+static int delay_flush_all() {
+    int ok = 1;
+
+    for (int i = 0; i < FAT16_DELAY_FILES; i++)
+        if (delays[i].vol && !delay_flush(&delays[i]))
+            ok = 0;
+    return ok;
+}
+
+int fat16_flush_delayed() {
+    return delay_flush_all();
+}
+
+// Open handles of the file see its new length
+static void delay_set_size(uint32_t lba, int index, uint32_t size) {
+    for (int i = 0; i < FAT16_MAX_FILES; i++)
+        if (files[i].vol == vol && files[i].dirLBA == lba && files[i].dirIndex == index)
+            files[i].size = size;
+}
+
+// Pick up the chain a flush gave the file
+static void file_reload(Fat16File *f) {
+    Fat16DirEntry e;
+    fat16_get_entry(f->dirLBA, f->dirIndex, &e);
+
+    if (f->cur.first != e.cluster) {
+        f->cur.first = e.cluster;
+        f->cur.cl = e.cluster;
+        f->cur.base = 0;
+        if (f->cur.map) map_reset(f->cur.map);
+    }
+}
+
+// Write at f->pos: bytes inside what is on disk are written in place,
+// bytes past it go to the file's buffer. A buffer that would overflow is
+// flushed and the rest written straight through.
+static uint32_t file_write_delayed(Fat16File *f, const uint8_t *src, uint32_t size) {
+    Fat16Delay *d = delay_find(f->dirLBA, f->dirIndex);
+    uint32_t diskSize = d ? d->diskSize : f->size;
+    uint32_t written = 0;
+
+    if (f->pos < diskSize) {
+        uint32_t n = diskSize - f->pos;
+        if (n > size) n = size;
+
+        written = file_write(f, src, n);
+        if (written < n) return written;
+    }
+    if (written == size) return written;
+
+    uint32_t end = f->pos + (size - written);
+
+    if (!d && end - diskSize <= FAT16_DELAY_BYTES) {
+        // take a free buffer, or flush the least recently used one
+        Fat16Delay *victim = &delays[0];
+        for (int i = 0; i < FAT16_DELAY_FILES; i++) {
+            if (!delays[i].vol) {
+                victim = &delays[i];
                 break;
             }
+            if (delays[i].lastUse < victim->lastUse)
+                victim = &delays[i];
         }
 
-        // get this directory name from parent
-        fat16_find_name_by_cluster(parent, cur, parts[depth]);
-        depth++;
+        // a buffer that cannot be written out keeps its slot
+        if (!victim->vol || delay_flush(victim)) {
+            d = victim;
+            d->vol = vol;
+            d->dirLBA = f->dirLBA;
+            d->dirIndex = f->dirIndex;
+            d->diskSize = diskSize;
+            d->len = 0;
+        }
+    }
 
-        cur = parent;
+    if (!d || end - d->diskSize > FAT16_DELAY_BYTES) {
+        if (d) {
+            int ok = delay_flush(d);
+            file_reload(f);
+            if (!ok) return written;
+        }
+        return written + file_write(f, src + written, size - written);
     }
 
-    // construct path manually
-    int pos = 0;
-    out[pos++] = '/';
+    k_memcpy(delay_data(d) + (f->pos - d->diskSize), src + written, size - written);
+    if (end - d->diskSize > d->len) d->len = end - d->diskSize;
+    d->lastUse = ++delayClock;
 
-    for (int i = depth - 1; i >= 0; i--) {
-        char *p = parts[i];
-        while (*p) out[pos++] = *p++;
-        if (i > 0) out[pos++] = '/';
+    f->pos = end;
+    if (end > f->size) {
+        f->size = end;
+        delay_set_size(f->dirLBA, f->dirIndex, end);
     }
+    return size;
+}
 
-    out[pos] = 0;
+int fat16_write(int fd, const void *buffer, uint32_t size) {
+    Fat16File *f = file_get(fd);
+    if (!f || !(f->mode & FAT16_O_WRITE)) return -1;
+
+    if ((f->mode & FAT16_O_APPEND) || f->pos > f->size)
+        f->pos = f->size;
+
+    Fat16Volume *cur = vol;
+    vol = f->vol;
+    uint32_t n = file_write_delayed(f, (const uint8_t *)buffer, size);
+    fat_flush();
+    vol = cur;
+
+    return n;
 }
 
-uint32_t fat16_read_partial(const char *filename, void *buffer, uint32_t size, uint32_t offset) {
+// ------------------------------------------------------------
+// Writes by name, through a handle that lives for one call
+// ------------------------------------------------------------
+static int file_open_temp(Fat16File *f, const char *filename) {
     char name83[11];
     fat16_format_83(name83, filename);
 
     uint32_t lba;
     int idx;
     Fat16DirEntry e;
-    if (!fat16_find_entry(currentDirCluster, name83, &lba, &idx, &e))
+    if (!fat16_find_entry(vol->cwd, name83, &lba, &idx, &e))
         return 0;
 
-    uint32_t filesize = e.size;
-    if (offset >= filesize) return 0;
+    if (!fat16_can_write(&e) || (e.attr & FAT16_ATTR_DIRECTORY))
+        return 0;
 
-    if (offset + size > filesize)
-        size = filesize - offset;
+    file_from_entry(f, lba, idx, &e, FAT16_O_WRITE);
+    return 1;
+}
 
-    uint32_t readBytes = 0;
-    uint16_t cl = e.cluster;
-    uint32_t clusterSize = FAT16_SECTOR_SIZE * bpb.sectorsPerCluster;
+// Replace the contents: clusters are rewritten in place, the chain
+// grows or loses its tail as needed. Written through, not buffered.
+int fat16_write_file(const char *filename, const void *data, uint32_t size) {
+    Fat16File f;
+    if (!file_open_temp(&f, filename))
+        return 0;
+
+    // bytes still buffered for the old contents are dropped
+    Fat16Delay *d = delay_find(f.dirLBA, f.dirIndex);
+    if (d) {
+        d->vol = 0;
+        f.size = d->diskSize;
+        delay_set_size(f.dirLBA, f.dirIndex, f.size);
+    }
 
-    // Skip clusters until offset is reached
-    uint32_t skip = offset / clusterSize;
-    uint32_t clusterOffset = offset % clusterSize;
+    uint32_t n = file_write(&f, (const uint8_t *)data, size);
+    if (n == size && f.size > size)
+        file_truncate(&f, size);
 
-    while (skip-- && cl >= 2)
-        cl = fat_next(cl);
+    fat_flush();
+    return n == size;
+}
 
-    if (cl < 2) return 0;
+uint32_t fat16_write_at(const char *filename, const void *data, uint32_t size, uint32_t offset) {
+    Fat16File f;
+    if (!file_open_temp(&f, filename) || offset > f.size)
+        return 0;
 
-    uint8_t temp[FAT16_SECTOR_SIZE];
+    f.pos = offset;
+    uint32_t n = file_write_delayed(&f, (const uint8_t *)data, size);
+    fat_flush();
+    return n;
+}
 
-    while (readBytes < size && cl >= 2) {
-        uint32_t lba_cluster = cluster_to_lba(cl);
+uint32_t fat16_append(const char *filename, const void *data, uint32_t size) {
+    Fat16File f;
+    if (!file_open_temp(&f, filename))
+        return 0;
 
-        for (uint8_t s = 0; s < bpb.sectorsPerCluster; s++) {
-            uint32_t remain = size - readBytes;
-            uint32_t copySize = FAT16_SECTOR_SIZE;
+    f.pos = f.size;
+    uint32_t n = file_write_delayed(&f, (const uint8_t *)data, size);
+    fat_flush();
+    return n;
+}
 
-            read_sector(lba_cluster + s, temp);
+// Reserve clusters for `bytes` without changing the file size, so later
+// writes up to there need no allocation and land in as few runs as the
+// free space allows
+int fat16_preallocate(const char *filename, uint32_t bytes) {
+    uint32_t clusterSize = FAT16_SECTOR_SIZE * vol->bpb.sectorsPerCluster;
+    Fat16File f;
 
-            uint8_t *src = temp;
+    if (!file_open_temp(&f, filename))
+        return 0;
+    if (!bytes)
+        return 1;
 
-            if (clusterOffset >= FAT16_SECTOR_SIZE) {
-                clusterOffset -= FAT16_SECTOR_SIZE;
-                continue;
-            }
+    uint16_t first = f.cur.first;
+    int ok = file_grow(&f, (bytes + clusterSize - 1) / clusterSize);
 
-            if (clusterOffset) {
-                src += clusterOffset;
-                copySize -= clusterOffset;
-                clusterOffset = 0;
-            }
+    if (ok && f.cur.first != first) {
+        Fat16DirEntry e;
+        fat16_get_entry(f.dirLBA, f.dirIndex, &e);
+        e.cluster = f.cur.first;
+        fat16_store_entry(f.dirLBA, f.dirIndex, &e);
+    }
 
-            if (copySize > remain) copySize = remain;
+    fat_flush();
+    return ok;
+}
 
-            k_memcpy((uint8_t*)buffer + readBytes, src, copySize);
+int fat16_lseek(int fd, int offset, int whence) {
+    Fat16File *f = file_get(fd);
+    if (!f) return -1;
 
-            readBytes += copySize;
+    int base = 0;
+    if (whence == FAT16_SEEK_CUR) base = f->pos;
+    else if (whence == FAT16_SEEK_END) base = f->size;
+    else if (whence != FAT16_SEEK_SET) return -1;
 
-            if (readBytes >= size) break;
-        }
-        cl = fat_next(cl);
-    }
+    // FAT has no holes: the position stops at the end of the file
+    int pos = base + offset;
+    if (pos < 0) return -1;
+    if ((uint32_t)pos > f->size) pos = f->size;
 
-    return readBytes;
-}
\ No newline at end of file
+    f->pos = pos;
+    return pos;
+}
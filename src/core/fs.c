@@ -12,16 +12,12 @@ uint16_t fs_current_dir_cluster() {
 }
 
 void fs_list(int printHideFiles) {
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(fs_current_dir_cluster(), entries, 256);
-
-    for (int i = 0; i < n; i++) {
-        Fat16DirEntry *e = &entries[i];
-
-        if (e->name[0] == 0x00) break;
-        if (e->name[0] == 0xE5) continue;
-        if (e->attr == FAT16_ATTR_LFN) continue;
+    Fat16Dir dir;
+    Fat16DirEntry ent;
+    Fat16DirEntry *e = &ent;
 
+    fat16_opendir(&dir, fs_current_dir_cluster());
+    while (fat16_readdir(&dir, e, 0, 0)) {
         char type = (e->attr & FAT16_ATTR_DIRECTORY) ? 'd' : '-';
 
         uint8_t mode = e->flags;
@@ -36,16 +32,12 @@ void fs_list(int printHideFiles) {
 }
 
 void fs_list_long(int printHideFiles) {
-    Fat16DirEntry entries[256];
-    int n = fat16_load_directory(fs_current_dir_cluster(), entries, 256);
-
-    for (int i = 0; i < n; i++) {
-        Fat16DirEntry *e = &entries[i];
-
-        if (e->name[0] == 0x00) break;
-        if (e->name[0] == 0xE5) continue;
-        if (e->attr == FAT16_ATTR_LFN) continue;
+    Fat16Dir dir;
+    Fat16DirEntry ent;
+    Fat16DirEntry *e = &ent;
 
+    fat16_opendir(&dir, fs_current_dir_cluster());
+    while (fat16_readdir(&dir, e, 0, 0)) {
         // type
         char type = (e->attr & FAT16_ATTR_DIRECTORY) ? 'd' : '-';
 
@@ -100,6 +92,10 @@ int fs_write(const char *name, const void *buf, int size) {
     return fat16_write_file(name, buf, size);
 }
 
+int fs_append(const char *name, const void *buf, int size) {
+    return fat16_append(name, buf, size) == (uint32_t)size;
+}
+
 int fs_mkdir(const char *name) {
     return fat16_create_directory(name);
 }
@@ -123,27 +119,15 @@ int fs_get_entry(const char *name, Fat16DirEntry *outEntry, uint32_t *outLBA, in
     char name83[11];
     fat16_format_83(name83, name);
 
-    Fat16DirEntry entries[256];
-    int total = fat16_load_directory(cwd, entries, 256);
-
-    for (int i = 0; i < total; i++) {
-        // valid entry
-        if (entries[i].name[0] == 0x00) break;
-        if (entries[i].name[0] == 0xE5) continue;
-        if (entries[i].attr == FAT16_ATTR_LFN) continue;
-
-        if (k_memcmp(entries[i].name, name83, 11) == 0) {
+    Fat16Dir dir;
+    fat16_opendir(&dir, cwd);
 
-            // compute real LBA + index
-            uint32_t lba = fat16_entry_lba(cwd, i);
-            int index    = i % 16;
-
-            *outEntry = entries[i];
-            *outLBA   = lba;
-            *outIndex = index;
+    while (fat16_readdir(&dir, outEntry, outLBA, outIndex)) {
+        if (k_memcmp(outEntry->name, name83, 11) == 0) {
+            fat16_closedir(&dir);
             return 1;
         }
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,10 +1,15 @@
 #include <stdint.h>
 #include "ide.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "irq.h"
+#include "terminal.h"
 
 /*
  * ATA PIO ports
  */
 #define ATA_DATA       0x1F0
+#define ATA_ERROR      0x1F1
 #define ATA_SECCOUNT   0x1F2
 #define ATA_LBA0       0x1F3
 #define ATA_LBA1       0x1F4
@@ -12,13 +17,81 @@
 #define ATA_DRIVE      0x1F6
 #define ATA_STATUS     0x1F7
 #define ATA_CMD        0x1F7
+#define ATA_ALTSTATUS  0x3F6
+#define ATA_DEVCTRL    0x3F6   // write side of ALTSTATUS
 
-#define ATA_CMD_READ    0x20
-#define ATA_CMD_WRITE   0x30
+#define ATA_CTRL_SRST  0x04
+
+#define ATA_CMD_READ            0x20
+#define ATA_CMD_WRITE           0x30
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_WRITE_MULTIPLE  0xC5
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_IDENTIFY        0xEC
 
 #define ATA_SR_BSY      0x80
 #define ATA_SR_DRDY     0x40
+#define ATA_SR_DF       0x20
 #define ATA_SR_DRQ      0x08
+#define ATA_SR_ERR      0x01
+
+// One command can move at most 256 sectors (SECCOUNT = 0 means 256)
+#define ATA_MAX_SECTORS 256
+
+// Give up on a command that has not interrupted within 3 seconds
+#define IDE_TIMEOUT_TICKS (3 * IRQ_TIMER_HZ)
+
+/*
+ * Bus-master IDE (PIIX) registers, primary channel, offsets from BAR4
+ */
+#define BM_CMD          0x00
+#define BM_STATUS       0x02
+#define BM_PRDT         0x04
+
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08    // device -> memory
+
+#define BM_SR_ACTIVE    0x01
+#define BM_SR_ERR       0x02
+#define BM_SR_IRQ       0x04
+
+// 256 sectors = 128 KB, split at 64 KB boundaries -> at most 3 entries
+#define IDE_PRD_MAX     8
+#define PRD_EOT         0x8000
+
+// Physical Region Descriptor
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;     // 0 = 64 KB
+    uint16_t flags;
+} __attribute__((packed)) PrdEntry;
+
+// 64-byte aligned so the table never crosses a 64 KB boundary
+static PrdEntry prdt[IDE_PRD_MAX] __attribute__((aligned(64)));
+
+// Bus-master I/O base (0 = no DMA, PIO only)
+static uint16_t bm_base = 0;
+
+// Sectors per DRQ block for READ/WRITE MULTIPLE (0 = multiple mode off)
+static uint16_t ide_multiple = 0;
+
+// LBA28 capacity reported by IDENTIFY
+static uint32_t ide_sectors = 0;
+
+// IRQ14 state: set by ide_irq(), consumed by ata_wait_irq()
+static int ide_irq_ready = 0;
+static volatile int     ide_irq_fired = 0;
+static volatile uint8_t ide_irq_status = 0;
+static volatile uint8_t ide_irq_bm = 0;
+
+static BlockDevice ideDev;
+
+// Last failed command, for error reporting
+static uint8_t ide_err_status = 0;
+static uint8_t ide_err_code = 0;
 
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile("outb %0, %1" :: "a"(val), "Nd"(port));
@@ -40,53 +113,464 @@ static inline uint16_t inw(uint16_t port) {
     return ret;
 }
 
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile("outl %0, %1" :: "a"(val), "Nd"(port));
+}
+
+// ~400ns: give the drive time to update STATUS after a command/select
+static inline void ata_delay() {
+    for (int i = 0; i < 4; i++)
+        inb(ATA_ALTSTATUS);
+}
+
 static void ata_wait_busy() {
     while (inb(ATA_STATUS) & ATA_SR_BSY) {}
 }
 
-static void ata_wait_drq() {
-    while (!(inb(ATA_STATUS) & ATA_SR_DRQ)) {}
+// Wait for the next data block: 1 when it is there, 0 if the drive
+// reports an error, -1 if it raises no DRQ within IDE_TIMEOUT_TICKS
+static int ata_wait_drq() {
+    uint32_t start = irq_ticks();
+
+    for (;;) {
+        uint8_t st = inb(ATA_STATUS);
+
+        if (!(st & ATA_SR_BSY)) {
+            if (st & (ATA_SR_ERR | ATA_SR_DF)) return 0;
+            if (st & ATA_SR_DRQ) return 1;
+        }
+        if (irq_ticks() - start > IDE_TIMEOUT_TICKS)
+            return -1;
+    }
+}
+
+// ------------------------------------------------------------
+// IRQ14: latch status (reading STATUS acknowledges INTRQ)
+// ------------------------------------------------------------
+static void ide_irq() {
+    if (bm_base)
+        ide_irq_bm = inb(bm_base + BM_STATUS);
+    ide_irq_status = inb(ATA_STATUS);
+
+    // a busy drive did not raise this one (the line may be shared)
+    if (!(ide_irq_status & ATA_SR_BSY))
+        ide_irq_fired = 1;
+}
+
+// Sleep with hlt until IRQ14 fires; returns 0 on timeout
+static int ata_wait_irq() {
+    uint32_t start = irq_ticks();
+
+    for (;;) {
+        __asm__ volatile("cli");
+
+        if (ide_irq_fired) {
+            ide_irq_fired = 0;
+            __asm__ volatile("sti");
+            return 1;
+        }
+
+        if (irq_ticks() - start > IDE_TIMEOUT_TICKS) {
+            __asm__ volatile("sti");
+            return 0;
+        }
+
+        // sti takes effect after hlt starts, so no wakeup is lost
+        __asm__ volatile("sti; hlt");
+    }
+}
+
+static void ata_set_multiple(uint16_t count);
+
+static void ata_reset() {
+    outb(ATA_DEVCTRL, ATA_CTRL_SRST);
+    ata_delay();
+    outb(ATA_DEVCTRL, 0);
+    ata_delay();
+    ata_wait_busy();
+
+    // SRST drops multiple mode on most drives
+    if (ide_multiple)
+        ata_set_multiple(ide_multiple);
+}
+
+static int ata_fail(const char *what, uint32_t lba, uint8_t st) {
+    ide_err_status = st;
+    ide_err_code = (st & ATA_SR_ERR) ? inb(ATA_ERROR) : 0;
+
+    terminal_printf("[IDE] %s at LBA %u (status %x, error %x)\n",
+                    what, lba, ide_err_status, ide_err_code);
+    return 0;
 }
 
 /*
- * Read 1 sector (512 bytes)
+ * Wait until the drive has finished the current phase of a command.
+ * With IRQ14 available the CPU sleeps in hlt; otherwise we poll.
+ * Returns 0 on timeout or when ERR/DF is set.
  */
-void ide_read_sector(uint32_t lba, uint8_t* buf) {
+static int ata_wait_event(uint32_t lba, int needDrq) {
+    uint8_t st;
+
+    if (ide_irq_ready) {
+        if (!ata_wait_irq()) {
+            ata_fail("timeout", lba, inb(ATA_ALTSTATUS));
+            ata_reset();
+            return 0;
+        }
+        st = ide_irq_status;
+        while (st & ATA_SR_BSY)
+            st = inb(ATA_ALTSTATUS);
+    } else {
+        uint32_t start = irq_ticks();
+
+        do {
+            st = inb(ATA_STATUS);
+            if (irq_ticks() - start > IDE_TIMEOUT_TICKS) {
+                ata_fail("timeout", lba, st);
+                ata_reset();
+                return 0;
+            }
+        } while ((st & ATA_SR_BSY) ||
+                 (needDrq && !(st & (ATA_SR_DRQ | ATA_SR_ERR | ATA_SR_DF))));
+    }
+
+    if (st & (ATA_SR_ERR | ATA_SR_DF))
+        return ata_fail("error", lba, st);
+
+    if (needDrq && !(st & ATA_SR_DRQ))
+        return ata_fail("no data", lba, st);
+
+    return 1;
+}
+
+static void ata_issue(uint8_t cmd, uint32_t lba, uint16_t count) {
     ata_wait_busy();
 
-    outb(ATA_SECCOUNT, 1);
+    ide_irq_fired = 0;
+
+    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+    outb(ATA_SECCOUNT, (uint8_t)count);     // 256 -> 0
     outb(ATA_LBA0, (uint8_t)(lba));
     outb(ATA_LBA1, (uint8_t)(lba >> 8));
     outb(ATA_LBA2, (uint8_t)(lba >> 16));
-    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_CMD, ATA_CMD_READ);
+    outb(ATA_CMD, cmd);
+
+    ata_delay();
+}
+
+/*
+ * Locate the PCI IDE controller (QEMU: PIIX3/PIIX4) and its
+ * bus-master register block.
+ */
+static void ide_dma_init() {
+    PciDevice dev;
+
+    bm_base = 0;
 
+    if (!pci_find_class(0x01, 0x01, &dev))
+        return;
+
+    // progIf bit 7: bus-master capable, bit 0: primary in native mode
+    if (!(dev.progIf & 0x80) || (dev.progIf & 0x01))
+        return;
+
+    if (!pci_bar_is_io(&dev, 4))
+        return;
+
+    pci_enable(&dev, PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+    bm_base = (uint16_t)pci_bar(&dev, 4);
+}
+
+static void ata_set_multiple(uint16_t count) {
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_SECCOUNT, (uint8_t)count);
+    outb(ATA_CMD, ATA_CMD_SET_MULTIPLE);
+    ata_delay();
     ata_wait_busy();
-    ata_wait_drq();
+
+    if (inb(ATA_STATUS) & (ATA_SR_ERR | ATA_SR_DF))
+        ide_multiple = 0;                   // stay on READ/WRITE SECTORS
+    else
+        ide_multiple = count;
+}
+
+/*
+ * IDENTIFY the master drive and switch it to multiple mode so that
+ * READ/WRITE MULTIPLE can move several sectors per DRQ block.
+ */
+void ide_init() {
+    uint16_t id[256];
+
+    ide_multiple = 0;
+    ide_sectors = 0;
+
+    outb(ATA_DRIVE, 0xA0);
+    ata_delay();
+    outb(ATA_SECCOUNT, 0);
+    outb(ATA_LBA0, 0);
+    outb(ATA_LBA1, 0);
+    outb(ATA_LBA2, 0);
+    outb(ATA_CMD, ATA_CMD_IDENTIFY);
+    ata_delay();
+
+    uint8_t st = inb(ATA_STATUS);
+    if (st == 0 || st == 0xFF) return;      // no drive / no controller
+    if (ata_wait_drq() <= 0) return;        // ATAPI / error / no answer
 
     for (int i = 0; i < 256; i++)
-        ((uint16_t*)buf)[i] = inw(ATA_DATA);
+        id[i] = inw(ATA_DATA);
+
+    ide_sectors = id[60] | ((uint32_t)id[61] << 16);
+
+    // word 49 bit 8 = DMA supported
+    if (id[49] & 0x0100)
+        ide_dma_init();
+
+    // word 47 bits 7:0 = max sectors per DRQ block
+    uint16_t maxMulti = id[47] & 0xFF;
+    if (maxMulti >= 2)
+        ata_set_multiple(maxMulti);
+
+    // from here on every command completes through IRQ14 (nIEN = 0);
+    // with the line's handler chain full the driver keeps polling
+    if (irq_install_handler(IRQ_ATA_PRIMARY, ide_irq)) {
+        outb(ATA_DEVCTRL, 0);
+        ide_irq_fired = 0;
+        ide_irq_ready = 1;
+    }
+
+    ideDev.sectorCount = ide_sectors;
+    blockdev_register(&ideDev);
+}
+
+uint32_t ide_sector_count() {
+    return ide_sectors;
+}
+
+void ide_last_error(uint8_t *status, uint8_t *error) {
+    if (status) *status = ide_err_status;
+    if (error)  *error  = ide_err_code;
+}
+
+// ------------------------------------------------------------
+// PIO: one command, up to 256 sectors
+// ------------------------------------------------------------
+static int ata_pio_read(uint32_t lba, uint16_t n, uint16_t *dst) {
+    uint16_t block = ide_multiple ? ide_multiple : 1;
+
+    ata_issue(ide_multiple ? ATA_CMD_READ_MULTIPLE : ATA_CMD_READ, lba, n);
+
+    // one interrupt per DRQ block
+    for (uint16_t done = 0; done < n; done += block) {
+        uint16_t sectors = (n - done) < block ? (n - done) : block;
+
+        if (!ata_wait_event(lba + done, 1)) return 0;
+
+        for (int i = 0; i < sectors * 256; i++)
+            *dst++ = inw(ATA_DATA);
+    }
+    return 1;
+}
+
+static int ata_pio_write(uint32_t lba, uint16_t n, const uint16_t *src) {
+    uint16_t block = ide_multiple ? ide_multiple : 1;
+
+    ata_issue(ide_multiple ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_WRITE, lba, n);
+
+    // the first block is requested without an interrupt
+    int r = ata_wait_drq();
+    if (r <= 0) {
+        ata_fail(r ? "timeout" : "error", lba, inb(ATA_ALTSTATUS));
+        if (r < 0) ata_reset();
+        return 0;
+    }
+
+    for (uint16_t done = 0; done < n; ) {
+        uint16_t sectors = (n - done) < block ? (n - done) : block;
+
+        for (int i = 0; i < sectors * 256; i++)
+            outw(ATA_DATA, *src++);
+
+        done += sectors;
+
+        // interrupt = next block wanted, or command complete
+        if (!ata_wait_event(lba + done, done < n)) return 0;
+    }
+    return 1;
+}
+
+// ------------------------------------------------------------
+// DMA: describe the buffer with PRDs (identity-mapped, so the
+// virtual address is the physical one). Each PRD may not cross
+// a 64 KB boundary. Returns 0 if the buffer cannot be used.
+// ------------------------------------------------------------
+static int ide_build_prdt(const void *buf, uint32_t bytes) {
+    uint32_t addr = (uint32_t)buf;
+    int n = 0;
+
+    if (addr & 1) return 0;     // PRD buffers must be word aligned
+
+    while (bytes) {
+        if (n == IDE_PRD_MAX) return 0;
+
+        uint32_t len = ((addr & 0xFFFF0000u) + 0x10000u) - addr;
+        if (len > bytes) len = bytes;
+
+        prdt[n].addr  = addr;
+        prdt[n].bytes = (uint16_t)len;
+        prdt[n].flags = 0;
+
+        addr  += len;
+        bytes -= len;
+        n++;
+    }
+
+    prdt[n - 1].flags = PRD_EOT;
+    return n;
+}
+
+// Returns 1 ok, 0 drive error, -1 if DMA cannot be used (caller falls back to PIO)
+static int ata_dma(int write, uint32_t lba, uint16_t n, const void *buf) {
+    if (!bm_base || !ide_build_prdt(buf, (uint32_t)n * 512))
+        return -1;
+
+    outb(bm_base + BM_CMD, 0);
+    outl(bm_base + BM_PRDT, (uint32_t)prdt);
+    outb(bm_base + BM_STATUS, BM_SR_ERR | BM_SR_IRQ);   // write-1-to-clear
+
+    ata_issue(write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, lba, n);
+
+    outb(bm_base + BM_CMD, BM_CMD_START | (write ? 0 : BM_CMD_READ));
+
+    uint8_t bm, st;
+
+    if (ide_irq_ready) {
+        if (!ata_wait_irq()) {
+            outb(bm_base + BM_CMD, 0);
+            ata_fail("DMA timeout", lba, inb(ATA_ALTSTATUS));
+            ata_reset();
+            return 0;
+        }
+        bm = ide_irq_bm | inb(bm_base + BM_STATUS);
+    } else {
+        do {
+            bm = inb(bm_base + BM_STATUS);
+        } while (!(bm & (BM_SR_IRQ | BM_SR_ERR)));
+    }
+
+    outb(bm_base + BM_CMD, 0);
+
+    ata_wait_busy();
+    st = inb(ATA_STATUS);           // also acknowledges INTRQ
+
+    outb(bm_base + BM_STATUS, BM_SR_ERR | BM_SR_IRQ);
+
+    if (bm & BM_SR_ERR) {
+        // controller-side failure: stop using DMA, retry this one with PIO
+        bm_base = 0;
+        return -1;
+    }
+
+    if (st & (ATA_SR_ERR | ATA_SR_DF))
+        return ata_fail("DMA error", lba, st);
+
+    return 1;
+}
+
+/*
+ * Read `count` sectors starting at `lba`.
+ * Up to 256 sectors are moved by a single command, by DMA when
+ * the controller supports it and PIO otherwise.
+ */
+int ide_read_sectors(uint32_t lba, uint32_t count, uint8_t* buf) {
+    if (!ide_sectors) return 0;
+
+    while (count) {
+        uint16_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+
+        int r = ata_dma(0, lba, n, buf);
+        if (r < 0)
+            r = ata_pio_read(lba, n, (uint16_t*)buf);
+        if (!r) return 0;
+
+        lba += n;
+        buf += n * 512;
+        count -= n;
+    }
+    return 1;
+}
+
+/*
+ * Write `count` sectors starting at `lba`.
+ */
+int ide_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buf) {
+    if (!ide_sectors) return 0;
+
+    while (count) {
+        uint16_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+
+        int r = ata_dma(1, lba, n, buf);
+        if (r < 0)
+            r = ata_pio_write(lba, n, (const uint16_t*)buf);
+        if (!r) return 0;
+
+        lba += n;
+        buf += n * 512;
+        count -= n;
+    }
+    return 1;
+}
+
+/*
+ * Read 1 sector (512 bytes)
+ */
+void ide_read_sector(uint32_t lba, uint8_t* buf) {
+    ide_read_sectors(lba, 1, buf);
 }
 
 /*
  * Write 1 sector (512 bytes)
  */
 void ide_write_sector(uint32_t lba, const uint8_t* buf) {
-    ata_wait_busy();
+    ide_write_sectors(lba, 1, buf);
+}
 
-    outb(ATA_SECCOUNT, 1);
-    outb(ATA_LBA0, (uint8_t)(lba));
-    outb(ATA_LBA1, (uint8_t)(lba >> 8));
-    outb(ATA_LBA2, (uint8_t)(lba >> 16));
-    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_CMD, ATA_CMD_WRITE);
+/*
+ * Write back the drive's volatile cache
+ */
+int ide_flush() {
+    if (!ide_sectors) return 0;
 
-    ata_wait_busy();
-    ata_wait_drq();
+    ata_issue(ATA_CMD_FLUSH_CACHE, 0, 0);
+    return ata_wait_event(0, 0);
+}
 
-    for (int i = 0; i < 256; i++)
-        outw(ATA_DATA, ((const uint16_t*)buf)[i]);
+// ------------------------------------------------------------
+// Block device glue
+// ------------------------------------------------------------
+static int ide_bdev_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    (void)dev;
+    return ide_read_sectors(lba, count, buf);
+}
 
-    // flush
-    ata_wait_busy();
+static int ide_bdev_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    (void)dev;
+    return ide_write_sectors(lba, count, buf);
 }
+
+static int ide_bdev_flush(BlockDevice *dev) {
+    (void)dev;
+    return ide_flush();
+}
+
+static const BlockDeviceOps ideOps = {
+    .read  = ide_bdev_read,
+    .write = ide_bdev_write,
+    .flush = ide_bdev_flush,
+};
+
+static BlockDevice ideDev = {
+    .name       = "ide0",
+    .ops        = &ideOps,
+    .sectorSize = BLOCKDEV_SECTOR_SIZE,
+};
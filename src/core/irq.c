@@ -0,0 +1,164 @@
+#include "irq.h"
+
+/*
+ * IDT + 8259 PIC + PIT.
+ * IRQ0..15 are remapped to vectors 0x20..0x2F. Only lines that have
+ * a handler are unmasked; the keyboard stays polled.
+ */
+#define PIC1_CMD    0x20
+#define PIC1_DATA   0x21
+#define PIC2_CMD    0xA0
+#define PIC2_DATA   0xA1
+#define PIC_EOI     0x20
+
+#define PIT_CH0     0x40
+#define PIT_CMD     0x43
+#define PIT_BASE_HZ 1193182
+
+#define IRQ_VECTOR_BASE 0x20
+#define KERNEL_CS       0x08        // code selector from boot.asm GDT
+
+typedef struct {
+    uint16_t offsetLow;
+    uint16_t selector;
+    uint8_t  zero;
+    uint8_t  typeAttr;
+    uint16_t offsetHigh;
+} __attribute__((packed)) IdtEntry;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) IdtPtr;
+
+static IdtEntry idt[256];
+// PCI INTx lines can be shared, so a line has a short chain of
+// handlers; each one checks and acknowledges its own device
+static irq_handler_t handlers[16][IRQ_MAX_SHARED];
+static volatile uint32_t ticks = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// ------------------------------------------------------------
+// Entry stubs: save registers, call irq_dispatch(n), iret
+// ------------------------------------------------------------
+#define IRQ_STUB(n)                     \
+    __asm__(".global irq_stub" #n "\n"  \
+            "irq_stub" #n ":\n"         \
+            "    pusha\n"               \
+            "    cld\n"                 \
+            "    pushl $" #n "\n"       \
+            "    call irq_dispatch\n"   \
+            "    addl $4, %esp\n"       \
+            "    popa\n"                \
+            "    iret\n");              \
+    extern void irq_stub##n(void);
+
+IRQ_STUB(0)  IRQ_STUB(1)  IRQ_STUB(2)  IRQ_STUB(3)
+IRQ_STUB(4)  IRQ_STUB(5)  IRQ_STUB(6)  IRQ_STUB(7)
+IRQ_STUB(8)  IRQ_STUB(9)  IRQ_STUB(10) IRQ_STUB(11)
+IRQ_STUB(12) IRQ_STUB(13) IRQ_STUB(14) IRQ_STUB(15)
+
+static void (*const stubs[16])(void) = {
+    irq_stub0,  irq_stub1,  irq_stub2,  irq_stub3,
+    irq_stub4,  irq_stub5,  irq_stub6,  irq_stub7,
+    irq_stub8,  irq_stub9,  irq_stub10, irq_stub11,
+    irq_stub12, irq_stub13, irq_stub14, irq_stub15,
+};
+
+__attribute__((used))
+void irq_dispatch(uint32_t irq) {
+    if (irq == IRQ_TIMER)
+        ticks++;
+
+    for (int i = 0; i < IRQ_MAX_SHARED && handlers[irq][i]; i++)
+        handlers[irq][i]();
+
+    if (irq >= 8)
+        outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+static void idt_set_gate(int vec, void (*fn)(void)) {
+    uint32_t addr = (uint32_t)fn;
+
+    idt[vec].offsetLow  = addr & 0xFFFF;
+    idt[vec].selector   = KERNEL_CS;
+    idt[vec].zero       = 0;
+    idt[vec].typeAttr   = 0x8E;     // present, ring 0, 32-bit interrupt gate
+    idt[vec].offsetHigh = addr >> 16;
+}
+
+static void pic_remap() {
+    outb(PIC1_CMD, 0x11);           // ICW1: init + ICW4
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, IRQ_VECTOR_BASE);
+    outb(PIC2_DATA, IRQ_VECTOR_BASE + 8);
+    outb(PIC1_DATA, 0x04);          // slave on IRQ2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);          // 8086 mode
+    outb(PIC2_DATA, 0x01);
+
+    // everything masked until a handler is installed
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+static void irq_unmask(int irq) {
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = IRQ_CASCADE;
+    }
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+}
+
+static void pit_init(uint32_t hz) {
+    uint16_t divisor = PIT_BASE_HZ / hz;
+
+    outb(PIT_CMD, 0x36);            // channel 0, lo/hi, mode 3
+    outb(PIT_CH0, divisor & 0xFF);
+    outb(PIT_CH0, divisor >> 8);
+}
+
+void irq_init(void) {
+    IdtPtr ptr;
+
+    pic_remap();
+
+    for (int i = 0; i < 16; i++)
+        idt_set_gate(IRQ_VECTOR_BASE + i, stubs[i]);
+
+    ptr.limit = sizeof(idt) - 1;
+    ptr.base  = (uint32_t)idt;
+    __asm__ volatile("lidt %0" :: "m"(ptr));
+
+    pit_init(IRQ_TIMER_HZ);
+    irq_unmask(IRQ_TIMER);
+
+    __asm__ volatile("sti");
+}
+
+int irq_install_handler(int irq, irq_handler_t handler) {
+    int i = 0;
+
+    while (i < IRQ_MAX_SHARED && handlers[irq][i] && handlers[irq][i] != handler)
+        i++;
+    if (i == IRQ_MAX_SHARED)
+        return 0;
+
+    handlers[irq][i] = handler;
+    irq_unmask(irq);
+    return 1;
+}
+
+uint32_t irq_ticks(void) {
+    return ticks;
+}
@@ -2,8 +2,13 @@
 #include "keyboard.h"
 #include "shell.h"
 #include "ide.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "ramdisk.h"
+#include "blockdev.h"
 #include "fat16.h"
 #include "syscall.h"
+#include "irq.h"
 
 extern uint8_t _data_vma[];
 extern uint8_t _data_lma[];
@@ -31,6 +36,7 @@ void kmain(void) {
     keyboard_flush_buffer();
 
     syscall_init();
+    irq_init();
 
     terminal_clear();
     terminal_write_line("VisualOS v0.4 (FAT16 Mode)");
@@ -39,19 +45,40 @@ void kmain(void) {
     // ----------------------------------------------------
     // Initialize disk and FAT16
     // ----------------------------------------------------
-    if (!fat16_init()) {
+    // probe order is mount preference: virtio-blk, SATA, IDE
+    virtio_blk_init();
+    ahci_init();
+    ide_init();
+
+    BlockDevice *disk = blockdev_get(0);
+
+#ifdef VISUALOS_RAMDISK
+    // serve the whole volume from memory
+    if (disk)
+        disk = ramdisk_load(disk, disk->sectorCount);
+#endif
+
+    if (!fat16_init(disk)) {
         terminal_write_line("FATAL: FAT16 init failed!");
         for(;;);
     }
 
-    terminal_write_line("FAT16 filesystem ready");
+    // FAT16 volumes on any other disk are mounted alongside
+    for (int i = 1; i < blockdev_count(); i++) {
+        BlockDevice *d = blockdev_get(i);
+        if (d != disk)
+            fat16_mount(d);
+    }
+
+    terminal_write("FAT16 filesystem ready on ");
+    terminal_write_line(disk->name);
     terminal_write_line("");
 
     // ----------------------------------------------------
     // Test reading sector 0
     // ----------------------------------------------------
     uint8_t buf[512];
-    ide_read_sector(0, buf);
+    blockdev_read(disk, 0, 1, buf);
     terminal_write_line("BOOT sector read OK");
     terminal_write_line("");
 
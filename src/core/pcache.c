@@ -0,0 +1,175 @@
+#include "pcache.h"
+#include "string.h"
+
+#define PCACHE_BUCKETS  1024
+#define PCACHE_NONE     (-1)
+
+typedef struct {
+    const void *owner;          // 0 = page unused
+    uint16_t    cluster;
+    uint8_t     index;
+    uint8_t     pad;
+    int16_t     hashNext;
+    int16_t     lruPrev;        // towards the most recently used end
+    int16_t     lruNext;        // (free list link while unused)
+} PcachePage;
+
+static PcachePage *pages = (PcachePage *)PCACHE_META_BASE;
+
+static inline uint8_t *page_data(int idx) {
+    return (uint8_t *)PCACHE_DATA_BASE + idx * PCACHE_PAGE_SIZE;
+}
+
+static int16_t buckets[PCACHE_BUCKETS];
+static int16_t lruHead = PCACHE_NONE;
+static int16_t lruTail = PCACHE_NONE;
+static int16_t freeList = PCACHE_NONE;
+static int     ready = 0;
+
+static PcacheStats stats;
+
+// ------------------------------------------------------------
+// Setup (the page table is outside BSS, so it is set up here)
+// ------------------------------------------------------------
+static void pcache_setup() {
+    for (int i = 0; i < PCACHE_BUCKETS; i++)
+        buckets[i] = PCACHE_NONE;
+
+    for (int i = 0; i < PCACHE_MAX_PAGES; i++) {
+        pages[i].owner = 0;
+        pages[i].lruNext = (i + 1 < PCACHE_MAX_PAGES) ? i + 1 : PCACHE_NONE;
+    }
+    freeList = 0;
+
+    stats.budget = PCACHE_DEFAULT_PAGES;
+    ready = 1;
+}
+
+static inline int bucket_of(const void *owner, uint16_t cluster, uint8_t index) {
+    uint32_t h = (uint32_t)owner * 31 + cluster * 64 + index;
+    return (h ^ (h >> 10)) % PCACHE_BUCKETS;
+}
+
+static int find(const void *owner, uint16_t cluster, uint8_t index) {
+    for (int i = buckets[bucket_of(owner, cluster, index)]; i != PCACHE_NONE; i = pages[i].hashNext)
+        if (pages[i].owner == owner && pages[i].cluster == cluster && pages[i].index == index)
+            return i;
+    return PCACHE_NONE;
+}
+
+static void lru_unlink(int idx) {
+    PcachePage *p = &pages[idx];
+
+    if (p->lruPrev != PCACHE_NONE) pages[p->lruPrev].lruNext = p->lruNext;
+    else lruHead = p->lruNext;
+
+    if (p->lruNext != PCACHE_NONE) pages[p->lruNext].lruPrev = p->lruPrev;
+    else lruTail = p->lruPrev;
+}
+
+static void lru_push(int idx) {
+    pages[idx].lruPrev = PCACHE_NONE;
+    pages[idx].lruNext = lruHead;
+    if (lruHead != PCACHE_NONE) pages[lruHead].lruPrev = idx;
+    else lruTail = idx;
+    lruHead = idx;
+}
+
+// Unhash a page and put it back on the free list
+static void release(int idx) {
+    PcachePage *p = &pages[idx];
+    int16_t *link = &buckets[bucket_of(p->owner, p->cluster, p->index)];
+
+    while (*link != idx)
+        link = &pages[*link].hashNext;
+    *link = p->hashNext;
+
+    lru_unlink(idx);
+    p->owner = 0;
+    p->lruNext = freeList;
+    freeList = idx;
+    stats.pages--;
+}
+
+// ------------------------------------------------------------
+// Public interface
+// ------------------------------------------------------------
+int pcache_lookup(const void *owner, uint16_t cluster, uint8_t index, void *out) {
+    if (!ready) pcache_setup();
+
+    int idx = find(owner, cluster, index);
+    if (idx == PCACHE_NONE) {
+        stats.misses++;
+        return 0;
+    }
+
+    lru_unlink(idx);
+    lru_push(idx);
+    k_memcpy(out, page_data(idx), PCACHE_PAGE_SIZE);
+    stats.hits++;
+    return 1;
+}
+
+// Presence test for readahead; does not count as a hit or touch the LRU
+int pcache_contains(const void *owner, uint16_t cluster, uint8_t index) {
+    if (!ready) pcache_setup();
+    return find(owner, cluster, index) != PCACHE_NONE;
+}
+
+void pcache_insert(const void *owner, uint16_t cluster, uint8_t index, const void *data) {
+    if (!ready) pcache_setup();
+
+    int idx = find(owner, cluster, index);
+
+    if (idx != PCACHE_NONE) {
+        lru_unlink(idx);
+    } else {
+        if (stats.pages >= stats.budget) {
+            if (lruTail == PCACHE_NONE) return;     // budget of 0
+            release(lruTail);
+            stats.evictions++;
+        }
+
+        idx = freeList;
+        freeList = pages[idx].lruNext;
+
+        int b = bucket_of(owner, cluster, index);
+        pages[idx].owner = owner;
+        pages[idx].cluster = cluster;
+        pages[idx].index = index;
+        pages[idx].hashNext = buckets[b];
+        buckets[b] = idx;
+        stats.pages++;
+    }
+
+    lru_push(idx);
+    k_memcpy(page_data(idx), data, PCACHE_PAGE_SIZE);
+}
+
+void pcache_invalidate(const void *owner, uint16_t cluster, uint8_t first, uint8_t count) {
+    if (!ready || stats.pages == 0) return;
+
+    for (int i = first; i < first + count; i++) {
+        int idx = find(owner, cluster, i);
+        if (idx != PCACHE_NONE)
+            release(idx);
+    }
+}
+
+void pcache_set_budget(uint32_t budget) {
+    if (!ready) pcache_setup();
+
+    if (budget > PCACHE_MAX_PAGES)
+        budget = PCACHE_MAX_PAGES;
+
+    stats.budget = budget;
+    while (stats.pages > budget) {
+        release(lruTail);
+        stats.evictions++;
+    }
+}
+
+void pcache_get_stats(PcacheStats *out) {
+    if (!ready) pcache_setup();
+    *out = stats;
+}
@@ -0,0 +1,135 @@
+#include "pci.h"
+
+/*
+ * PCI configuration mechanism #1
+ */
+#define PCI_CONFIG_ADDR  0xCF8
+#define PCI_CONFIG_DATA  0xCFC
+
+#define PCI_VENDOR_ID    0x00
+#define PCI_COMMAND      0x04
+#define PCI_CLASS_REV    0x08
+#define PCI_HEADER_TYPE  0x0E
+#define PCI_BAR0         0x10
+
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile("outl %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static uint32_t pci_cfg_read(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t addr = 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                    ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDR, addr);
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_cfg_write(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    uint32_t addr = 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                    ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDR, addr);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+uint32_t pci_read32(const PciDevice *dev, uint8_t offset) {
+    return pci_cfg_read(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_read16(const PciDevice *dev, uint8_t offset) {
+    uint32_t v = pci_cfg_read(dev->bus, dev->slot, dev->func, offset);
+    return (uint16_t)(v >> ((offset & 2) * 8));
+}
+
+void pci_write32(const PciDevice *dev, uint8_t offset, uint32_t value) {
+    pci_cfg_write(dev->bus, dev->slot, dev->func, offset, value);
+}
+
+void pci_write16(const PciDevice *dev, uint8_t offset, uint16_t value) {
+    uint32_t v = pci_cfg_read(dev->bus, dev->slot, dev->func, offset);
+    int shift = (offset & 2) * 8;
+
+    v &= ~(0xFFFFu << shift);
+    v |= (uint32_t)value << shift;
+    pci_cfg_write(dev->bus, dev->slot, dev->func, offset, v);
+}
+
+// ------------------------------------------------------------
+// Brute-force bus scan. `match` decides which function we want.
+// ------------------------------------------------------------
+typedef int (*pci_match_fn)(const PciDevice *dev, uint32_t a, uint32_t b);
+
+static int pci_scan(pci_match_fn match, uint32_t a, uint32_t b, PciDevice *out) {
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            for (uint8_t func = 0; func < 8; func++) {
+                uint32_t id = pci_cfg_read(bus, slot, func, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (func == 0) break;   // no device in this slot
+                    continue;
+                }
+
+                uint32_t cls = pci_cfg_read(bus, slot, func, PCI_CLASS_REV);
+
+                PciDevice dev;
+                dev.bus       = bus;
+                dev.slot      = slot;
+                dev.func      = func;
+                dev.vendor    = id & 0xFFFF;
+                dev.device    = id >> 16;
+                dev.classCode = cls >> 24;
+                dev.subclass  = (cls >> 16) & 0xFF;
+                dev.progIf    = (cls >> 8) & 0xFF;
+
+                if (match(&dev, a, b)) {
+                    *out = dev;
+                    return 1;
+                }
+
+                // single-function device: skip functions 1..7
+                if (func == 0) {
+                    uint32_t hdr = pci_cfg_read(bus, slot, 0, PCI_HEADER_TYPE);
+                    if (!((hdr >> 16) & 0x80)) break;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int match_class(const PciDevice *dev, uint32_t cls, uint32_t sub) {
+    return dev->classCode == cls && dev->subclass == sub;
+}
+
+static int match_id(const PciDevice *dev, uint32_t vendor, uint32_t device) {
+    return dev->vendor == vendor && dev->device == device;
+}
+
+int pci_find_class(uint8_t classCode, uint8_t subclass, PciDevice *out) {
+    return pci_scan(match_class, classCode, subclass, out);
+}
+
+int pci_find_device(uint16_t vendor, uint16_t device, PciDevice *out) {
+    return pci_scan(match_id, vendor, device, out);
+}
+
+// Raw BAR value with the type bits masked off
+uint32_t pci_bar(const PciDevice *dev, int index) {
+    uint32_t bar = pci_read32(dev, PCI_BAR0 + index * 4);
+    if (bar & 1)
+        return bar & ~0x3u;     // I/O space
+    return bar & ~0xFu;         // memory space
+}
+
+int pci_bar_is_io(const PciDevice *dev, int index) {
+    return pci_read32(dev, PCI_BAR0 + index * 4) & 1;
+}
+
+void pci_enable(const PciDevice *dev, uint16_t cmdBits) {
+    uint16_t cmd = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, cmd | cmdBits);
+}
@@ -0,0 +1,55 @@
+#include "ramdisk.h"
+#include "string.h"
+#include "terminal.h"
+
+static BlockDevice ramdiskDev;
+
+static int ramdisk_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    k_memcpy(buf, (uint8_t *)dev->priv + lba * BLOCKDEV_SECTOR_SIZE, count * BLOCKDEV_SECTOR_SIZE);
+    return 1;
+}
+
+static int ramdisk_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    k_memcpy((uint8_t *)dev->priv + lba * BLOCKDEV_SECTOR_SIZE, buf, count * BLOCKDEV_SECTOR_SIZE);
+    return 1;
+}
+
+static const BlockDeviceOps ramdiskOps = {
+    .read  = ramdisk_read,
+    .write = ramdisk_write,
+    .flush = 0,                 // nothing to flush
+};
+
+BlockDevice *ramdisk_init(void *base, uint32_t sectors) {
+    ramdiskDev.name        = "ram0";
+    ramdiskDev.ops         = &ramdiskOps;
+    ramdiskDev.sectorCount = sectors;
+    ramdiskDev.sectorSize  = BLOCKDEV_SECTOR_SIZE;
+    ramdiskDev.priv        = base;
+
+    if (!blockdev_register(&ramdiskDev))
+        return 0;
+    return &ramdiskDev;
+}
+
+BlockDevice *ramdisk_load(BlockDevice *src, uint32_t sectors) {
+    uint8_t *base = (uint8_t *)RAMDISK_BASE;
+
+    if (sectors > src->sectorCount) sectors = src->sectorCount;
+    if (sectors > RAMDISK_MAX_SECTORS) sectors = RAMDISK_MAX_SECTORS;
+
+    // 64 KB per request keeps every driver on its fast path
+    for (uint32_t done = 0; done < sectors; ) {
+        uint32_t n = sectors - done;
+        if (n > 128) n = 128;
+
+        if (!blockdev_read(src, done, n, base + done * BLOCKDEV_SECTOR_SIZE)) {
+            terminal_write_line("[RAMDISK] load failed");
+            return 0;
+        }
+        done += n;
+    }
+
+    terminal_printf("RAM disk: %u sectors loaded from %s\n", sectors, src->name);
+    return ramdisk_init(base, sectors);
+}
@@ -6,6 +6,9 @@
 #include "fat16.h"
 #include "pmm.h"
 #include "elf.h"
+#include "blkq.h"
+#include "bcache.h"
+#include "pcache.h"
 
 #define SHELL_BUF 128
 #define MAX_ARGS  16
@@ -26,6 +29,19 @@ static char *skip_spaces(char *p) {
     return p;
 }
 
+// Decimal number; 0 if `s` is not one
+static int parse_uint(const char *s, uint32_t *out) {
+    uint32_t v = 0;
+
+    if (!*s) return 0;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') return 0;
+        v = v * 10 + (*s - '0');
+    }
+    *out = v;
+    return 1;
+}
+
 static int parse_args(char *input, char **argv, int max) {
     int argc = 0;
     char *p = skip_spaces(input);
@@ -55,8 +71,14 @@ static void cmd_help() {
     terminal_write_line("  cat <file>     - Print file contents");
     terminal_write_line("  touch <file>   - Create empty file");
     terminal_write_line("  rm <file>      - Delete file");
-    terminal_write_line("  write <f> <t>  - Write text to file");
+    terminal_write_line("  write <f> [>>] <t> - Write (or append) text to file");
     terminal_write_line("  pwd            - Show current directory");
+    terminal_write_line("  vol [n]        - List volumes / switch volume");
+    terminal_write_line("  iostat         - Buffer cache / request queue statistics");
+    terminal_write_line("  sync           - Write cached changes to disk");
+    terminal_write_line("  df             - Show free space per volume");
+    terminal_write_line("  cache [budget <KB>] - Page cache usage / set its size");
+    terminal_write_line("  fallocate <f> <KB> - Reserve contiguous space for a file");
     terminal_write_line("  clear          - Clear screen");
 }
 
@@ -84,7 +106,7 @@ static void cmd_ls(int argc, char **argv) {
 }
 
 static void cmd_pwd() {
-    char path[128];
+    char path[FAT16_PATH_MAX];
     k_memset(path, 0, sizeof(path));
     fat16_get_path(path);
     terminal_write_line(path);
@@ -147,16 +169,21 @@ static void cmd_rm(int argc, char **argv) {
 }
 
 static void cmd_write(int argc, char **argv) {
-    if (argc < 3) {
+    // write <file> >> <text> appends
+    int append = argc >= 4 && str_eq(argv[2], ">>");
+
+    if (argc < 3 || (str_eq(argv[2], ">>") && !append)) {
         terminal_error();
-        terminal_write_line("write: usage: write <file> <text>");
+        terminal_write_line("write: usage: write <file> [>>] <text>");
         return;
     }
 
     const char *filename = argv[1];
-    const char *text     = argv[2];
+    const char *text     = append ? argv[3] : argv[2];
+    int ok = append ? fs_append(filename, text, k_strlen(text))
+                    : fs_write(filename, text, k_strlen(text));
 
-    if (!fs_write(filename, text, k_strlen(text))) {
+    if (!ok) {
         terminal_error();
         terminal_write("write: cannot write to ");
         terminal_write(filename);
@@ -294,15 +321,136 @@ static void cmd_exec(int argc, char **argv) {
     terminal_write_line("[program exited]");
 }
 
+static void cmd_vol(int argc, char **argv) {
+    if (argc >= 2) {
+        int n = argv[1][0] - '0';
+
+        if (argv[1][1] != 0 || !fat16_set_volume(n)) {
+            terminal_error();
+            terminal_write("vol: no such volume: ");
+            terminal_write_line(argv[1]);
+        }
+        return;
+    }
+
+    int cur = fat16_get_volume();
+
+    for (int i = 0; i < fat16_volume_count(); i++) {
+        Fat16VolumeInfo info;
+        fat16_volume_info(i, &info);
+
+        terminal_printf("%c %d: %s  start %u  %u sectors  %u x %u B clusters\n",
+                        i == cur ? '*' : ' ', i, info.deviceName, info.startLBA,
+                        info.sectors, info.clusterCount, info.clusterSize);
+    }
+}
+
+static void cmd_df() {
+    for (int i = 0; i < fat16_volume_count(); i++) {
+        Fat16VolumeInfo info;
+        fat16_volume_info(i, &info);
+
+        // cluster counts -> KB (clusters are a multiple of 512 B)
+        uint32_t spc = info.clusterSize / 512;
+        uint32_t total = info.clusterCount * spc / 2;
+        uint32_t free = info.freeClusters * spc / 2;
+
+        terminal_printf("%d: %s  %u KB total, %u KB used, %u KB free (%u clusters)\n",
+                        i, info.deviceName, total, total - free, free, info.freeClusters);
+    }
+}
+
+static void cmd_fallocate(int argc, char **argv) {
+    uint32_t kb;
+
+    if (argc < 3 || !parse_uint(argv[2], &kb)) {
+        terminal_error();
+        terminal_write_line("fallocate: usage: fallocate <file> <KB>");
+        return;
+    }
+
+    if (!fat16_preallocate(argv[1], kb * 1024)) {
+        terminal_error();
+        terminal_write("fallocate: cannot reserve space for ");
+        terminal_write_line(argv[1]);
+    }
+}
+
+static void cmd_sync() {
+    if (!fat16_sync()) {
+        terminal_error();
+        terminal_write_line("sync: write failed");
+    }
+}
+
+static void cmd_iostat() {
+    BcacheStats cs;
+    bcache_get_stats(&cs);
+
+    terminal_printf("cache: hits %u  misses %u  bypassed %u\n",
+                    cs.hits, cs.misses, cs.bypassed);
+    terminal_printf("       %u / %d buffers, %u dirty, %u evictions, %u writebacks\n",
+                    cs.cached, BCACHE_BUFFERS, cs.dirty, cs.evictions, cs.writebacks);
+
+    BlkqStats st;
+    blkq_get_stats(&st);
+
+    terminal_printf("queue: queued %u  absorbed %u  bypassed %u  read hits %u\n",
+                    st.queued, st.absorbed, st.bypassed, st.readHits);
+    terminal_printf("       drains %u  commands %u  merged %u\n",
+                    st.drains, st.commands, st.merged);
+    terminal_printf("       depth %u  max depth %u / %d\n",
+                    st.depth, st.maxDepth, BLKQ_DEPTH);
+
+    uint32_t dh, dm;
+    fat16_dcache_stats(&dh, &dm);
+    terminal_printf("dcache: hits %u  misses %u\n", dh, dm);
+
+    Fat16VolumeInfo info;
+    if (fat16_volume_info(fat16_get_volume(), &info))
+        terminal_printf("fat:   %u sector writes, %u mirror writes\n",
+                        info.fatWrites, info.mirrorWrites);
+}
+
+static void cmd_cache(int argc, char **argv) {
+    if (argc >= 2) {
+        uint32_t kb;
+
+        if (argc < 3 || !str_eq(argv[1], "budget") || !parse_uint(argv[2], &kb)) {
+            terminal_error();
+            terminal_write_line("usage: cache [budget <KB>]");
+            return;
+        }
+        pcache_set_budget(kb * 1024 / PCACHE_PAGE_SIZE);
+    }
+
+    PcacheStats st;
+    pcache_get_stats(&st);
+
+    // percent without 64-bit division
+    uint32_t total = st.hits + st.misses;
+    uint32_t rate = 0;
+    if (total >= 0x1000000) rate = st.hits / (total / 100);
+    else if (total) rate = st.hits * 100 / total;
+
+    terminal_printf("page cache: %u / %u pages (%u / %u KB)\n",
+                    st.pages, st.budget,
+                    st.pages * PCACHE_PAGE_SIZE / 1024, st.budget * PCACHE_PAGE_SIZE / 1024);
+    terminal_printf("            hits %u  misses %u  hit rate %u%%  evictions %u\n",
+                    st.hits, st.misses, rate, st.evictions);
+}
+
 // ---------------------------------------------------------
 // Prompt
 // ---------------------------------------------------------
 static void render_prompt() {
-    char path[128];
+    char path[FAT16_PATH_MAX];
     k_memset(path, 0, sizeof(path));
     fat16_get_path(path);
 
     terminal_write("visualos:");
+    if (fat16_volume_count() > 1)
+        terminal_printf("%d:", fat16_get_volume());
     terminal_write(path);
     terminal_write(" $ ");
 }
@@ -344,11 +492,23 @@ void shell_run() {
         else if (str_eq(argv[0], "mem"))     cmd_mem();
         else if (str_eq(argv[0], "rename"))  cmd_rename(argc, argv);
         else if (str_eq(argv[0], "exec"))    cmd_exec(argc, argv);
+        else if (str_eq(argv[0], "vol"))     cmd_vol(argc, argv);
+        else if (str_eq(argv[0], "iostat"))  cmd_iostat();
+        else if (str_eq(argv[0], "sync"))    cmd_sync();
+        else if (str_eq(argv[0], "df"))      cmd_df();
+        else if (str_eq(argv[0], "cache"))   cmd_cache(argc, argv);
+        else if (str_eq(argv[0], "fallocate")) cmd_fallocate(argc, argv);
 
         else {
             terminal_error();
             terminal_write("Unknown command: ");
             terminal_write_line(argv[0]);
         }
+
+        if (!fat16_flush_delayed()) {
+            terminal_error();
+            terminal_write_line("write: disk full, data not saved yet");
+        }
+        fat16_bootlog_tick();
     }
 }
@@ -0,0 +1,362 @@
+#include "virtio_blk.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "irq.h"
+#include "terminal.h"
+#include "string.h"
+
+/*
+ * Legacy (virtio 0.9.5) PCI virtio-blk with one split virtqueue.
+ * Every request is a 3-descriptor chain: header, data, status.
+ */
+#define VIRTIO_VENDOR           0x1AF4
+#define VIRTIO_DEV_BLK_LEGACY   0x1001
+
+// Legacy I/O BAR0 register layout
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_PFN        0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_STATUS           0x12
+#define VIRTIO_REG_ISR              0x13
+#define VIRTIO_REG_CONFIG           0x14    // capacity (u64) without MSI-X
+
+#define VIRTIO_STATUS_ACK           0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+#define VIRTQ_DESC_F_NEXT           1
+#define VIRTQ_DESC_F_WRITE          2       // device writes into buffer
+#define VIRTQ_USED_F_NO_NOTIFY      1
+
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_T_FLUSH          4
+
+#define VIRTIO_BLK_F_FLUSH          (1u << 9)
+
+// Queue memory is sized for the largest legacy queue we accept
+#define VIRTQ_MAX_SIZE              256
+#define VIRTQ_PAGE                  4096
+
+// Requests per batch and sectors per request
+#define VIRTIO_BLK_MAX_REQS         32
+#define VIRTIO_BLK_MAX_SECTORS      128
+
+#define VIRTIO_TIMEOUT_TICKS        (3 * IRQ_TIMER_HZ)
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) VirtqDesc;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed)) VirtqAvail;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) VirtqUsedElem;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    VirtqUsedElem ring[];
+} __attribute__((packed)) VirtqUsed;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) VirtioBlkReq;
+
+// desc (16*256) | avail (6+2*256, page aligned) | used (6+8*256)
+static uint8_t vq_mem[3 * VIRTQ_PAGE] __attribute__((aligned(VIRTQ_PAGE)));
+
+static VirtqDesc           *vq_desc;
+static VirtqAvail          *vq_avail;
+static volatile VirtqUsed  *vq_used;
+static uint16_t             vq_size;
+static uint16_t             vq_last_used;
+
+static VirtioBlkReq     req_hdr[VIRTIO_BLK_MAX_REQS];
+static volatile uint8_t req_status[VIRTIO_BLK_MAX_REQS];
+
+static uint16_t vio_base = 0;
+static uint32_t vio_sectors = 0;
+static int      vio_irq_line = -1;
+static int      vio_has_flush = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile("outb %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(uint16_t port, uint16_t val) {
+    __asm__ volatile("outw %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile("outl %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void mb() {
+    __asm__ volatile("" ::: "memory");
+}
+
+// Reading ISR acknowledges the interrupt; waiters check the used ring
+static void virtio_blk_irq() {
+    if (!vio_base) return;          // device given up after a failed reset
+    inb(vio_base + VIRTIO_REG_ISR);
+}
+
+// ------------------------------------------------------------
+// Reset the device and set the queue up from scratch. The reset makes
+// the device drop whatever was still posted, so the ring can be reused.
+// ------------------------------------------------------------
+static int virtio_blk_setup(uint16_t base) {
+    outb(base + VIRTIO_REG_STATUS, 0);                     // reset
+    outb(base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK);
+    outb(base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+    // only FLUSH is of interest
+    uint32_t features = inl(base + VIRTIO_REG_DEVICE_FEATURES);
+    vio_has_flush = (features & VIRTIO_BLK_F_FLUSH) != 0;
+    outl(base + VIRTIO_REG_GUEST_FEATURES, features & VIRTIO_BLK_F_FLUSH);
+
+    outw(base + VIRTIO_REG_QUEUE_SELECT, 0);
+    uint16_t size = inw(base + VIRTIO_REG_QUEUE_SIZE);
+
+    if (size == 0 || size > VIRTQ_MAX_SIZE) {
+        outb(base + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+        return 0;
+    }
+
+    // legacy layout: avail follows desc, used starts on the next page
+    uint32_t availOff = size * sizeof(VirtqDesc);
+    uint32_t usedOff  = (availOff + 6 + 2 * size + VIRTQ_PAGE - 1) & ~(VIRTQ_PAGE - 1);
+
+    k_memset(vq_mem, 0, sizeof(vq_mem));
+    vq_size      = size;
+    vq_desc      = (VirtqDesc *)vq_mem;
+    vq_avail     = (VirtqAvail *)(vq_mem + availOff);
+    vq_used      = (volatile VirtqUsed *)(vq_mem + usedOff);
+    vq_last_used = 0;
+
+    outl(base + VIRTIO_REG_QUEUE_PFN, (uint32_t)vq_mem / VIRTQ_PAGE);
+
+    outb(base + VIRTIO_REG_STATUS,
+         VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Post `n` prepared chains (heads 0, 3, 6, ...) and kick once
+// ------------------------------------------------------------
+static int virtio_blk_run_batch(int n) {
+    for (int i = 0; i < n; i++)
+        vq_avail->ring[(vq_avail->idx + i) % vq_size] = i * 3;
+
+    mb();
+    vq_avail->idx += n;
+    mb();
+
+    if (!(vq_used->flags & VIRTQ_USED_F_NO_NOTIFY))
+        outw(vio_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+
+    uint16_t target = vq_last_used + n;
+    uint32_t start = irq_ticks();
+
+    for (;;) {
+        __asm__ volatile("cli");
+
+        if (vq_used->idx == target) {
+            __asm__ volatile("sti");
+            break;
+        }
+
+        if (irq_ticks() - start > VIRTIO_TIMEOUT_TICKS) {
+            __asm__ volatile("sti");
+            terminal_write_line("[VIRTIO] request timeout, resetting device");
+
+            // late completions must not count against the next batch
+            if (!virtio_blk_setup(vio_base))
+                vio_base = 0;
+            return 0;
+        }
+
+        if (vio_irq_line >= 0)
+            __asm__ volatile("sti; hlt");
+        else
+            __asm__ volatile("sti");
+    }
+
+    vq_last_used = target;
+
+    for (int i = 0; i < n; i++)
+        if (req_status[i] != 0) return 0;
+
+    return 1;
+}
+
+// count == 0 builds a data-less chain (header -> status), used for FLUSH
+static void virtio_blk_prepare(int slot, uint32_t type, uint32_t lba, uint32_t count, uint8_t *buf) {
+    VirtqDesc *d = &vq_desc[slot * 3];
+    int write = (type == VIRTIO_BLK_T_OUT);
+
+    req_hdr[slot].type = type;
+    req_hdr[slot].reserved = 0;
+    req_hdr[slot].sector = lba;
+    req_status[slot] = 0xFF;
+
+    d[0].addr  = (uint32_t)&req_hdr[slot];
+    d[0].len   = sizeof(VirtioBlkReq);
+    d[0].flags = VIRTQ_DESC_F_NEXT;
+    d[0].next  = slot * 3 + (count ? 1 : 2);
+
+    d[1].addr  = (uint32_t)buf;
+    d[1].len   = count * 512;
+    d[1].flags = VIRTQ_DESC_F_NEXT | (write ? 0 : VIRTQ_DESC_F_WRITE);
+    d[1].next  = slot * 3 + 2;
+
+    d[2].addr  = (uint32_t)&req_status[slot];
+    d[2].len   = 1;
+    d[2].flags = VIRTQ_DESC_F_WRITE;
+    d[2].next  = 0;
+}
+
+static int virtio_blk_transfer(int write, uint32_t lba, uint32_t count, uint8_t *buf) {
+    if (!vio_base) return 0;
+
+    int maxReqs = vq_size / 3;
+    if (maxReqs > VIRTIO_BLK_MAX_REQS) maxReqs = VIRTIO_BLK_MAX_REQS;
+
+    while (count) {
+        int n = 0;
+
+        // one batch: as many requests as fit, one notify for all of them
+        while (count && n < maxReqs) {
+            uint32_t c = count > VIRTIO_BLK_MAX_SECTORS ? VIRTIO_BLK_MAX_SECTORS : count;
+
+            virtio_blk_prepare(n++, write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, c, buf);
+
+            lba += c;
+            buf += c * 512;
+            count -= c;
+        }
+
+        if (!virtio_blk_run_batch(n)) return 0;
+    }
+    return 1;
+}
+
+int virtio_blk_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf) {
+    return virtio_blk_transfer(0, lba, count, buf);
+}
+
+int virtio_blk_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf) {
+    return virtio_blk_transfer(1, lba, count, (uint8_t *)buf);
+}
+
+int virtio_blk_flush() {
+    if (!vio_base) return 0;
+    if (!vio_has_flush) return 1;       // write-through device
+
+    virtio_blk_prepare(0, VIRTIO_BLK_T_FLUSH, 0, 0, 0);
+    return virtio_blk_run_batch(1);
+}
+
+// ------------------------------------------------------------
+// Block device glue
+// ------------------------------------------------------------
+static int virtio_bdev_read(BlockDevice *dev, uint32_t lba, uint32_t count, void *buf) {
+    (void)dev;
+    return virtio_blk_read_sectors(lba, count, buf);
+}
+
+static int virtio_bdev_write(BlockDevice *dev, uint32_t lba, uint32_t count, const void *buf) {
+    (void)dev;
+    return virtio_blk_write_sectors(lba, count, buf);
+}
+
+static int virtio_bdev_flush(BlockDevice *dev) {
+    (void)dev;
+    return virtio_blk_flush();
+}
+
+static const BlockDeviceOps virtioOps = {
+    .read  = virtio_bdev_read,
+    .write = virtio_bdev_write,
+    .flush = virtio_bdev_flush,
+};
+
+static BlockDevice virtioDev = {
+    .name       = "vda",
+    .ops        = &virtioOps,
+    .sectorSize = BLOCKDEV_SECTOR_SIZE,
+};
+
+// ------------------------------------------------------------
+// Init
+// ------------------------------------------------------------
+int virtio_blk_init() {
+    PciDevice dev;
+
+    if (!pci_find_device(VIRTIO_VENDOR, VIRTIO_DEV_BLK_LEGACY, &dev))
+        return 0;
+
+    if (!pci_bar_is_io(&dev, 0))
+        return 0;
+
+    pci_enable(&dev, PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+    uint16_t base = (uint16_t)pci_bar(&dev, 0);
+
+    if (!virtio_blk_setup(base))
+        return 0;
+
+    uint8_t line = pci_read16(&dev, 0x3C) & 0xFF;
+    vio_base = base;
+    if (line < 16 && irq_install_handler(line, virtio_blk_irq))
+        vio_irq_line = line;
+
+    vio_sectors = inl(base + VIRTIO_REG_CONFIG);   // low 32 bits of capacity
+
+    terminal_printf("virtio-blk: %u sectors, queue size %u\n", vio_sectors, (uint32_t)vq_size);
+
+    virtioDev.sectorCount = vio_sectors;
+    blockdev_register(&virtioDev);
+    return 1;
+}
+
+int virtio_blk_present() {
+    return vio_base != 0;
+}
+
+uint32_t virtio_blk_sector_count() {
+    return vio_sectors;
+}